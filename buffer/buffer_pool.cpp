@@ -0,0 +1,113 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+
+BufferPool &BufferPool::instance()
+{
+    static BufferPool instance;
+    return instance;
+}
+
+BufferPool::BufferPool() : in_use_(0), allocated_(0)
+{
+}
+
+int BufferPool::class_index(size_t size)
+{
+    int index = 0;
+    while (index < CLASS_COUNT && class_size(index) < size)
+        ++index;
+    return index;
+}
+
+// 线程的缓存析构之后（主线程退出时静态对象还会归还缓冲区），借还直接走全局链表
+static thread_local bool local_cache_destroyed = false;
+
+BufferPool::local_cache *BufferPool::local()
+{
+    if (local_cache_destroyed)
+        return NULL;
+    static thread_local local_cache cache;
+    return &cache;
+}
+
+BufferPool::local_cache::~local_cache()
+{
+    local_cache_destroyed = true;
+    BufferPool &pool = BufferPool::instance();
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        for (char *buf : free_list[i])
+            pool.push_global(i, buf);
+        free_list[i].clear();
+    }
+}
+
+char *BufferPool::pop_global(int index)
+{
+    size_class &cls = classes_[index];
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    if (cls.free_list.empty())
+        return NULL;
+    char *buf = cls.free_list.back();
+    cls.free_list.pop_back();
+    return buf;
+}
+
+void BufferPool::push_global(int index, char *buf)
+{
+    size_class &cls = classes_[index];
+    {
+        std::lock_guard<std::mutex> lock(cls.mutex);
+        if (cls.free_list.size() * class_size(index) < IDLE_LIMIT / CLASS_COUNT)
+        {
+            cls.free_list.push_back(buf);
+            return;
+        }
+    }
+    free(buf);
+    allocated_.fetch_sub(class_size(index), std::memory_order_relaxed);
+}
+
+char *BufferPool::acquire(size_t size, size_t &capacity)
+{
+    int index = class_index(size);
+    if (index == CLASS_COUNT)
+        return NULL;
+    capacity = class_size(index);
+
+    char *buf = NULL;
+    local_cache *cache = local();
+    if (cache && !cache->free_list[index].empty())
+    {
+        buf = cache->free_list[index].back();
+        cache->free_list[index].pop_back();
+    }
+    else
+        buf = pop_global(index);
+
+    if (!buf)
+    {
+        buf = (char *)malloc(capacity);
+        if (!buf)
+            return NULL;
+        allocated_.fetch_add(capacity, std::memory_order_relaxed);
+    }
+    in_use_.fetch_add(capacity, std::memory_order_relaxed);
+    return buf;
+}
+
+void BufferPool::release(char *buf, size_t capacity)
+{
+    if (!buf)
+        return;
+    int index = class_index(capacity);
+    in_use_.fetch_sub(capacity, std::memory_order_relaxed);
+
+    // 读缓冲区在事件循环线程借、在工作线程还的情况很常见，本线程缓存满了就还给全局链表
+    local_cache *cache = local();
+    if (cache && cache->free_list[index].size() < LOCAL_CACHE_COUNT)
+        cache->free_list[index].push_back(buf);
+    else
+        push_global(index, buf);
+}
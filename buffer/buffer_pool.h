@@ -0,0 +1,67 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+/*************************************************************
+*连接读写缓冲区池：按2的幂分成MIN_BUFFER_SIZE到MAX_BUFFER_SIZE的几档
+*   - 连接收到数据时才借一个最小档的缓冲区，装满之后换更大一档，
+*     一个请求处理完（或者连接关闭）就还回来，空闲的keep-alive连接不占缓冲区
+*   - 每个线程先在自己的缓存中借还，不够或者太多时再访问全局的空闲链表
+*   - 全局每一档最多保留IDLE_LIMIT / CLASS_COUNT字节的空闲缓冲区，多出来的直接释放
+**************************************************************/
+
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class BufferPool
+{
+public:
+    static const size_t MIN_BUFFER_SIZE = 4 * 1024;
+    static const size_t MAX_BUFFER_SIZE = 256 * 1024;
+    static const int CLASS_COUNT = 7;                     // 4KB, 8KB, ..., 256KB
+    static const size_t IDLE_LIMIT = 64 * 1024 * 1024;    // 全局空闲缓冲区总大小上限
+    static const size_t LOCAL_CACHE_COUNT = 16;           // 每个线程每一档缓存的缓冲区个数
+
+    static BufferPool &instance();
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    // 借一个不小于size的缓冲区，capacity返回实际大小；size超过MAX_BUFFER_SIZE时返回NULL
+    char *acquire(size_t size, size_t &capacity);
+    // 归还acquire得到的缓冲区，capacity必须是acquire返回的大小
+    void release(char *buf, size_t capacity);
+
+    size_t in_use_bytes() const { return in_use_.load(std::memory_order_relaxed); }
+    size_t allocated_bytes() const { return allocated_.load(std::memory_order_relaxed); }
+
+private:
+    struct size_class
+    {
+        std::mutex mutex;
+        std::vector<char *> free_list;
+    };
+
+    // 线程退出时把缓存的缓冲区还给全局链表
+    struct local_cache
+    {
+        std::vector<char *> free_list[CLASS_COUNT];
+        ~local_cache();
+    };
+
+    BufferPool();
+
+    static int class_index(size_t size);
+    static size_t class_size(int index) { return MIN_BUFFER_SIZE << index; }
+    static local_cache *local();
+
+    char *pop_global(int index);
+    void push_global(int index, char *buf);
+
+    size_class classes_[CLASS_COUNT];
+    std::atomic<size_t> in_use_;    // 借出去的字节数
+    std::atomic<size_t> allocated_; // 当前分配的字节数（借出的 + 空闲的）
+};
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,73 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+/*************************************************************
+*定长对象池：一次分配SLAB_SIZE个对象（一个slab），用空闲链表借还
+*   - 第一次借用时才分配slab，空闲对象不够时再分配下一个
+*   - 归还的对象不析构，留在空闲链表中等待下一次借用，由使用者负责重置状态
+*   - slab在对象池析构之前不释放，还回来的对象地址一直有效
+**************************************************************/
+
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+template <typename T>
+class object_pool
+{
+public:
+    static const size_t SLAB_SIZE = 64;
+
+    object_pool() : in_use_(0) {}
+    ~object_pool()
+    {
+        for (size_t i = 0; i < slabs_.size(); ++i)
+            delete[] slabs_[i];
+    }
+
+    object_pool(const object_pool &) = delete;
+    object_pool &operator=(const object_pool &) = delete;
+
+    T *acquire()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty())
+        {
+            T *slab = new T[SLAB_SIZE];
+            slabs_.push_back(slab);
+            // 倒序放入，先借出slab中地址小的对象
+            for (size_t i = SLAB_SIZE; i > 0; --i)
+                free_.push_back(slab + i - 1);
+        }
+        T *obj = free_.back();
+        free_.pop_back();
+        ++in_use_;
+        return obj;
+    }
+
+    void release(T *obj)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(obj);
+        --in_use_;
+    }
+
+    size_t in_use()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_use_;
+    }
+    size_t allocated()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return slabs_.size() * SLAB_SIZE;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<T *> slabs_;
+    std::vector<T *> free_;
+    size_t in_use_;
+};
+
+#endif // OBJECT_POOL_H
@@ -0,0 +1,116 @@
+#include "file_cache.h"
+#include "../monitor/monitor_system.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <functional>
+
+FileCache &FileCache::instance()
+{
+    static FileCache instance;
+    return instance;
+}
+
+FileCache::FileCache() : capacity_(0), shard_capacity_(0), max_entry_size_(0)
+{
+}
+
+void FileCache::init(size_t capacity, size_t max_entry_size)
+{
+    capacity_ = capacity;
+    shard_capacity_ = capacity / SHARD_COUNT;
+    max_entry_size_ = max_entry_size < shard_capacity_ ? max_entry_size : shard_capacity_;
+}
+
+FileCache::shard &FileCache::shard_for(const std::string &path)
+{
+    return shards_[std::hash<std::string>()(path) % SHARD_COUNT];
+}
+
+// inode、大小和修改时间都没有变化才认为缓存有效
+bool FileCache::is_fresh(const cached_file &file, const struct stat &st)
+{
+    return file.ino == st.st_ino && file.size == st.st_size &&
+           file.mtime.tv_sec == st.st_mtim.tv_sec && file.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+std::shared_ptr<const cached_file> FileCache::load(const std::string &path, const struct stat &st)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::shared_ptr<const cached_file>();
+
+    std::shared_ptr<cached_file> file = std::make_shared<cached_file>();
+    file->data.resize(st.st_size);
+    size_t done = 0;
+    while (done < file->data.size())
+    {
+        ssize_t n = read(fd, &file->data[done], file->data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+    // 读取过程中文件被修改（变短），不放入缓存
+    if (done != file->data.size())
+        return std::shared_ptr<const cached_file>();
+
+    file->ino = st.st_ino;
+    file->size = st.st_size;
+    file->mtime = st.st_mtim;
+    return file;
+}
+
+void FileCache::insert(shard &s, const std::string &path, const std::shared_ptr<const cached_file> &file)
+{
+    std::unordered_map<std::string, std::list<shard::entry>::iterator>::iterator it = s.index.find(path);
+    if (it != s.index.end())
+    {
+        s.bytes -= it->second->second->data.size();
+        s.lru.erase(it->second);
+        s.index.erase(it);
+    }
+    s.lru.push_front(shard::entry(path, file));
+    s.index[path] = s.lru.begin();
+    s.bytes += file->data.size();
+
+    // 超出分片容量时从链表尾部淘汰最久未使用的文件
+    while (s.bytes > shard_capacity_ && !s.lru.empty())
+    {
+        s.bytes -= s.lru.back().second->data.size();
+        s.index.erase(s.lru.back().first);
+        s.lru.pop_back();
+    }
+}
+
+std::shared_ptr<const cached_file> FileCache::get(const std::string &path, const struct stat &st)
+{
+    if (!enabled() || (size_t)st.st_size > max_entry_size_ || st.st_size == 0)
+        return std::shared_ptr<const cached_file>();
+
+    shard &s = shard_for(path);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        std::unordered_map<std::string, std::list<shard::entry>::iterator>::iterator it = s.index.find(path);
+        if (it != s.index.end() && is_fresh(*it->second->second, st))
+        {
+            // 命中之后移动到链表头
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+            MonitorSystem::instance().record_file_cache(true);
+            return s.lru.front().second;
+        }
+    }
+
+    // 未命中或文件已经被修改，在锁外读取文件，避免阻塞同一分片上的其他请求
+    MonitorSystem::instance().record_file_cache(false);
+    std::shared_ptr<const cached_file> file = load(path, st);
+    if (!file)
+        return file;
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    insert(s, path, file);
+    return file;
+}
@@ -0,0 +1,70 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+/*************************************************************
+*静态文件内容缓存：按路径分片的LRU缓存，总大小有上限
+*   - do_request本来就要stat文件，命中时用stat结果（inode、大小、
+*     修改时间）校验缓存是否过期，不再open/mmap/munmap
+*   - 缓存项用shared_ptr交给连接，发送过程中被淘汰也不影响正在发送的数据
+*   - 单个文件超过max_entry_size不缓存（比如/uploads中的大文件，走sendfile）
+**************************************************************/
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/stat.h>
+
+struct cached_file
+{
+    std::string data;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+};
+
+class FileCache
+{
+public:
+    static FileCache &instance();
+
+    FileCache(const FileCache &) = delete;
+    FileCache &operator=(const FileCache &) = delete;
+
+    // capacity为0表示关闭缓存
+    void init(size_t capacity, size_t max_entry_size);
+
+    bool enabled() const { return capacity_ > 0; }
+
+    // 查找path对应的文件内容，st为调用者刚取得的stat结果；
+    // 未命中或已过期时读取文件并放入缓存，不能缓存时返回空指针
+    std::shared_ptr<const cached_file> get(const std::string &path, const struct stat &st);
+
+private:
+    FileCache();
+
+    static const int SHARD_COUNT = 16;
+
+    struct shard
+    {
+        typedef std::pair<std::string, std::shared_ptr<const cached_file> > entry;
+        std::mutex mutex;
+        std::list<entry> lru; // 链表头是最近使用的
+        std::unordered_map<std::string, std::list<entry>::iterator> index;
+        size_t bytes;
+        shard() : bytes(0) {}
+    };
+
+    shard &shard_for(const std::string &path);
+    static bool is_fresh(const cached_file &file, const struct stat &st);
+    static std::shared_ptr<const cached_file> load(const std::string &path, const struct stat &st);
+    void insert(shard &s, const std::string &path, const std::shared_ptr<const cached_file> &file);
+
+    size_t capacity_;       // 所有分片的总容量（字节）
+    size_t shard_capacity_; // 每个分片的容量
+    size_t max_entry_size_; // 单个文件的大小上限
+    shard shards_[SHARD_COUNT];
+};
+
+#endif // FILE_CACHE_H
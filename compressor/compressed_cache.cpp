@@ -0,0 +1,223 @@
+#include "compressed_cache.h"
+#include "compression_policy.h"
+#include "../monitor/monitor_system.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <chrono>
+
+// 超过这个大小的文件启动时不生成旁路文件
+static const off_t SIDECAR_MAX_SIZE = 16 * 1024 * 1024;
+
+CompressedCache &CompressedCache::instance()
+{
+    static CompressedCache instance;
+    return instance;
+}
+
+CompressedCache::CompressedCache() : bytes_(0), capacity_(0)
+{
+}
+
+void CompressedCache::init(size_t capacity)
+{
+    capacity_ = capacity;
+}
+
+std::string CompressedCache::make_key(const std::string &path, const struct stat &st,
+                                      ContentCompressor::EncodingType encoding)
+{
+    char suffix[96];
+    snprintf(suffix, sizeof(suffix), "|%lu|%ld|%ld.%09ld|%d",
+             (unsigned long)st.st_ino, (long)st.st_size,
+             (long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec, (int)encoding);
+    return path + suffix;
+}
+
+CompressedCache::buffer_ptr CompressedCache::get(const std::string &path, const struct stat &st,
+                                                 ContentCompressor::EncodingType encoding,
+                                                 const char *data, int quality)
+{
+    std::string key = make_key(path, st, encoding);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unordered_map<std::string, std::list<entry>::iterator>::iterator it = index_.find(key);
+        if (it != index_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return lru_.front().second;
+        }
+    }
+
+    // 未命中时在锁外压缩，文件修改之后键也随之变化，旧的压缩结果会被LRU淘汰
+    ContentCompressor compressor;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!compressor.compress(data, st.st_size, encoding, quality))
+        return buffer_ptr();
+    uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    size_t dot_pos = path.find_last_of('.');
+    MonitorSystem::instance().record_compression(dot_pos != std::string::npos ? path.substr(dot_pos + 1) : "",
+                                                 st.st_size, compressor.compressed_size(), time_us);
+    buffer_ptr buffer = std::make_shared<const std::vector<char> >(compressor.compressed_data());
+
+    // 超过缓存容量的结果不放入缓存，只给本次请求使用
+    if (buffer->size() > capacity_)
+        return buffer;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.find(key) == index_.end())
+    {
+        lru_.push_front(entry(key, buffer));
+        index_[key] = lru_.begin();
+        bytes_ += buffer->size();
+        while (bytes_ > capacity_ && !lru_.empty())
+        {
+            bytes_ -= lru_.back().second->size();
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+    return buffer;
+}
+
+const char *CompressedCache::sidecar_suffix(ContentCompressor::EncodingType encoding)
+{
+    switch (encoding)
+    {
+    case ContentCompressor::BROTLI:
+        return ".br";
+    case ContentCompressor::GZIP:
+        return ".gz";
+    case ContentCompressor::ZSTD:
+        return ".zst";
+    default:
+        return NULL;
+    }
+}
+
+bool CompressedCache::find_sidecar(const std::string &path, const struct stat &st,
+                                   ContentCompressor::EncodingType encoding,
+                                   std::string &sidecar_path, struct stat &sidecar_st)
+{
+    const char *suffix = sidecar_suffix(encoding);
+    if (!suffix || sidecars_.find(path) == sidecars_.end())
+        return false;
+
+    sidecar_path = path + suffix;
+    if (stat(sidecar_path.c_str(), &sidecar_st) < 0)
+        return false;
+    // 原文件在旁路文件生成之后被修改过，旁路文件已经过期
+    if (sidecar_st.st_mtim.tv_sec < st.st_mtim.tv_sec ||
+        (sidecar_st.st_mtim.tv_sec == st.st_mtim.tv_sec && sidecar_st.st_mtim.tv_nsec < st.st_mtim.tv_nsec))
+        return false;
+    return true;
+}
+
+// 先写临时文件再rename，请求线程不会读到写了一半的旁路文件
+bool CompressedCache::write_sidecar(const std::string &path, const struct stat &st,
+                                    const std::vector<char> &content,
+                                    ContentCompressor::EncodingType encoding)
+{
+    std::string sidecar = path + sidecar_suffix(encoding);
+    struct stat sidecar_st;
+    if (stat(sidecar.c_str(), &sidecar_st) == 0 && sidecar_st.st_mtim.tv_sec > st.st_mtim.tv_sec)
+        return true;
+
+    ContentCompressor compressor;
+    if (content.empty() ||
+        !compressor.compress(content.data(), content.size(), encoding, CompressionPolicy::best_quality(encoding)))
+        return false;
+    // 压缩之后没有变小的文件不需要旁路文件
+    if (compressor.compressed_size() >= content.size())
+        return false;
+
+    std::string tmp = sidecar + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+    if (fd < 0)
+        return false;
+    const std::vector<char> &out = compressor.compressed_data();
+    size_t done = 0;
+    while (done < out.size())
+    {
+        ssize_t n = write(fd, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+    if (done != out.size() || rename(tmp.c_str(), sidecar.c_str()) < 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void CompressedCache::build_dir(const std::string &dir, int &count)
+{
+    DIR *dp = opendir(dir.c_str());
+    if (!dp)
+        return;
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL)
+    {
+        std::string name(ent->d_name);
+        if (name == "." || name == "..")
+            continue;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+        {
+            // 用户上传的文件不预先压缩
+            if (name != "uploads")
+                build_dir(path, count);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode) || st.st_size > SIDECAR_MAX_SIZE)
+            continue;
+        size_t dot_pos = name.find_last_of('.');
+        std::string extension = dot_pos != std::string::npos ? name.substr(dot_pos + 1) : "";
+        if (!CompressionPolicy::instance().should_compress(extension, st.st_size))
+            continue;
+
+        std::vector<char> content(st.st_size);
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        ssize_t n = read(fd, content.data(), content.size());
+        close(fd);
+        if (n != st.st_size)
+            continue;
+
+        bool built = false;
+        if (write_sidecar(path, st, content, ContentCompressor::BROTLI))
+            built = true;
+        if (write_sidecar(path, st, content, ContentCompressor::GZIP))
+            built = true;
+        if (ContentCompressor::is_supported(ContentCompressor::ZSTD) &&
+            write_sidecar(path, st, content, ContentCompressor::ZSTD))
+            built = true;
+        if (built)
+        {
+            sidecars_.insert(path);
+            ++count;
+        }
+    }
+    closedir(dp);
+}
+
+int CompressedCache::build_sidecars(const std::string &root)
+{
+    int count = 0;
+    build_dir(root, count);
+    return count;
+}
@@ -0,0 +1,69 @@
+#ifndef COMPRESSED_CACHE_H
+#define COMPRESSED_CACHE_H
+
+/*************************************************************
+*压缩结果缓存：所有连接共享，同一个文件的同一种编码只压缩一次
+*   - 内存缓存以(路径, inode, 大小, 修改时间, 编码)为键，LRU淘汰
+*   - 启动时为站点目录下可压缩的文件预先生成.br/.gz（支持zstd时还有.zst）旁路文件，
+*     请求时旁路文件比原文件新就直接发送旁路文件（可以走文件缓存/sendfile）
+**************************************************************/
+
+#include <string>
+#include <vector>
+#include <list>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "content_compressor.h"
+
+class CompressedCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<char> > buffer_ptr;
+
+    static CompressedCache &instance();
+
+    CompressedCache(const CompressedCache &) = delete;
+    CompressedCache &operator=(const CompressedCache &) = delete;
+
+    void init(size_t capacity);
+
+    // 返回data（path文件内容，st为其stat结果）按encoding压缩之后的数据，压缩失败返回空指针；
+    // 未命中时以quality级别压缩
+    buffer_ptr get(const std::string &path, const struct stat &st,
+                   ContentCompressor::EncodingType encoding, const char *data, int quality);
+
+    // 遍历root目录，为可压缩的文件生成（或更新）.br、.gz和.zst旁路文件，返回生成的文件数
+    int build_sidecars(const std::string &root);
+
+    // 如果path存在比原文件新的encoding旁路文件，返回true并填入旁路文件路径和stat结果
+    bool find_sidecar(const std::string &path, const struct stat &st,
+                      ContentCompressor::EncodingType encoding,
+                      std::string &sidecar_path, struct stat &sidecar_st);
+
+private:
+    CompressedCache();
+
+    typedef std::pair<std::string, buffer_ptr> entry;
+
+    static std::string make_key(const std::string &path, const struct stat &st,
+                                ContentCompressor::EncodingType encoding);
+    static const char *sidecar_suffix(ContentCompressor::EncodingType encoding);
+    bool write_sidecar(const std::string &path, const struct stat &st,
+                       const std::vector<char> &content, ContentCompressor::EncodingType encoding);
+    void build_dir(const std::string &dir, int &count);
+
+    std::mutex mutex_;
+    std::list<entry> lru_; // 链表头是最近使用的
+    std::unordered_map<std::string, std::list<entry>::iterator> index_;
+    size_t bytes_;
+    size_t capacity_;
+
+    // 启动时生成过旁路文件的原文件路径，其余文件请求时不需要再stat旁路文件
+    std::set<std::string> sidecars_;
+};
+
+#endif // COMPRESSED_CACHE_H
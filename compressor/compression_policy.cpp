@@ -0,0 +1,111 @@
+#include "compression_policy.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <zlib.h>
+#include <brotli/encode.h>
+
+// 各负载档位对应的压缩级别：zlib为1-9，brotli为0-11，zstd为1-22
+static const int GZIP_QUALITY[] = {9, 6, 1};
+static const int BROTLI_QUALITY[] = {9, 5, 1};
+static const int ZSTD_QUALITY[] = {9, 3, 1};
+// zstd的最高级别是22，19以上需要大得多的内存，离线压缩也只用到19
+static const int ZSTD_BEST_QUALITY = 19;
+
+// 负载比例低于IDLE_RATIO为空闲，不低于BUSY_RATIO为繁忙
+static const double IDLE_RATIO = 0.5;
+static const double BUSY_RATIO = 1.0;
+
+CompressionPolicy &CompressionPolicy::instance()
+{
+    static CompressionPolicy instance;
+    return instance;
+}
+
+CompressionPolicy::CompressionPolicy() : workers_(0), level_(LOAD_NORMAL), next_sample_ms_(0)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpus_ = cpus > 0 ? (int)cpus : 1;
+}
+
+void CompressionPolicy::set_queue_probe(std::function<int()> probe, int workers)
+{
+    queue_probe_ = probe;
+    workers_ = workers > 0 ? workers : 1;
+}
+
+bool CompressionPolicy::should_compress(const std::string &extension, size_t size) const
+{
+    return size >= COMPRESS_MIN_SIZE && ContentCompressor::is_compressible(extension);
+}
+
+void CompressionPolicy::sample(int64_t now_ms)
+{
+    // 同一时刻只让一个线程采样，其他线程继续使用上一次的结果
+    int64_t next = next_sample_ms_.load(std::memory_order_relaxed);
+    if (now_ms < next || !next_sample_ms_.compare_exchange_strong(next, now_ms + SAMPLE_INTERVAL_MS))
+        return;
+
+    double ratio = 0;
+    double loadavg;
+    if (getloadavg(&loadavg, 1) == 1)
+        ratio = loadavg / cpus_;
+    if (queue_probe_)
+    {
+        double queued = (double)queue_probe_() / workers_;
+        if (queued > ratio)
+            ratio = queued;
+    }
+
+    int level = LOAD_NORMAL;
+    if (ratio < IDLE_RATIO)
+        level = LOAD_IDLE;
+    else if (ratio >= BUSY_RATIO)
+        level = LOAD_BUSY;
+    level_.store(level, std::memory_order_relaxed);
+}
+
+CompressionPolicy::LOAD_LEVEL CompressionPolicy::load_level()
+{
+    int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    sample(now_ms);
+    return (LOAD_LEVEL)level_.load(std::memory_order_relaxed);
+}
+
+int CompressionPolicy::quality(ContentCompressor::EncodingType encoding)
+{
+    LOAD_LEVEL level = load_level();
+    switch (encoding)
+    {
+    case ContentCompressor::BROTLI:
+        return BROTLI_QUALITY[level];
+    case ContentCompressor::ZSTD:
+        return ZSTD_QUALITY[level];
+    case ContentCompressor::GZIP:
+    case ContentCompressor::DEFLATE:
+        return GZIP_QUALITY[level];
+    case ContentCompressor::NONE:
+    default:
+        return 0;
+    }
+}
+
+int CompressionPolicy::best_quality(ContentCompressor::EncodingType encoding)
+{
+    switch (encoding)
+    {
+    case ContentCompressor::BROTLI:
+        return BROTLI_MAX_QUALITY;
+    case ContentCompressor::ZSTD:
+        return ZSTD_BEST_QUALITY;
+    case ContentCompressor::GZIP:
+    case ContentCompressor::DEFLATE:
+        return Z_BEST_COMPRESSION;
+    case ContentCompressor::NONE:
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef COMPRESSION_POLICY_H
+#define COMPRESSION_POLICY_H
+
+/*************************************************************
+*压缩策略：决定一个响应要不要压缩、用什么压缩级别
+*   - 小于COMPRESS_MIN_SIZE的包体和不可压缩的类型不压缩
+*   - 压缩级别按负载分三档：CPU负载（loadavg / CPU核数）和
+*     线程池队列深度（排队任务数 / 工作线程数）取较大者，
+*     空闲时用高压缩率，繁忙时用最快的级别
+*   - 负载最多每秒采样一次，请求线程只读取缓存的档位
+**************************************************************/
+
+#include <string>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+#include "content_compressor.h"
+
+class CompressionPolicy
+{
+public:
+    enum LOAD_LEVEL
+    {
+        LOAD_IDLE = 0,
+        LOAD_NORMAL,
+        LOAD_BUSY
+    };
+
+    static const size_t COMPRESS_MIN_SIZE = 1024; // 小于一个报文段的包体压缩收益很小
+    static const int SAMPLE_INTERVAL_MS = 1000;   // 负载采样间隔
+
+    static CompressionPolicy &instance();
+
+    CompressionPolicy(const CompressionPolicy &) = delete;
+    CompressionPolicy &operator=(const CompressionPolicy &) = delete;
+
+    // 注册返回当前排队任务数的函数，workers为处理这些任务的线程数
+    void set_queue_probe(std::function<int()> probe, int workers);
+
+    // 后缀名为extension、大小为size的包体是否需要压缩
+    bool should_compress(const std::string &extension, size_t size) const;
+
+    // 按当前负载选择encoding的压缩级别
+    int quality(ContentCompressor::EncodingType encoding);
+
+    // 离线压缩（启动时生成旁路文件）不受负载影响，使用最高级别
+    static int best_quality(ContentCompressor::EncodingType encoding);
+
+    LOAD_LEVEL load_level();
+
+private:
+    CompressionPolicy();
+
+    void sample(int64_t now_ms);
+
+    std::function<int()> queue_probe_;
+    int workers_;
+    int cpus_;
+    std::atomic<int> level_;
+    std::atomic<int64_t> next_sample_ms_;
+};
+
+#endif // COMPRESSION_POLICY_H
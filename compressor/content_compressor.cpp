@@ -1,10 +1,12 @@
 #include "content_compressor.h"
 #include <cstring>
+#include <cstdlib>
+#include <strings.h>
 #include <set>
 
-// 支持的压缩格式
+// 支持的压缩格式（png/jpg等本身已经压缩过的格式再压缩几乎没有收益）
 const std::set<std::string> ContentCompressor::compressible_types_ = {
-    "html", "htm", "css", "js", "json", "xml", "txt", "svg", "png"};
+    "html", "htm", "css", "js", "json", "xml", "txt", "svg"};
 
 ContentCompressor::ContentCompressor()
     : current_encoding_(NONE)
@@ -33,41 +35,190 @@ bool ContentCompressor::should_compress(const std::string &file_extension,
     }
 
     // 只压缩文本类型和常见Web资源
+    return is_compressible(file_extension);
+}
+
+bool ContentCompressor::is_compressible(const std::string &file_extension)
+{
     return compressible_types_.find(file_extension) != compressible_types_.end();
 }
 
-bool ContentCompressor::compress(const std::string &content, EncodingType encoding_type)
+const char *ContentCompressor::encoding_name(EncodingType encoding_type)
+{
+    switch (encoding_type)
+    {
+    case GZIP:
+        return "gzip";
+    case DEFLATE:
+        return "deflate";
+    case BROTLI:
+        return "br";
+    case ZSTD:
+        return "zstd";
+    case NONE:
+    default:
+        return "";
+    }
+}
+
+bool ContentCompressor::is_supported(EncodingType encoding_type)
+{
+    switch (encoding_type)
+    {
+    case GZIP:
+    case DEFLATE:
+    case BROTLI:
+        return true;
+    case ZSTD:
+#ifdef HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    case NONE:
+    default:
+        return false;
+    }
+}
+
+// 解析q值，格式为0、1或者带最多三位小数的0.xxx/1.000，非法时返回-1
+static double parse_qvalue(const char *begin, const char *end)
+{
+    if (begin == end || (*begin != '0' && *begin != '1'))
+        return -1;
+    char *stop = NULL;
+    std::string value(begin, end);
+    double q = strtod(value.c_str(), &stop);
+    if (*stop != '\0' || q < 0 || q > 1)
+        return -1;
+    return q;
+}
+
+ContentCompressor::EncodingType ContentCompressor::negotiate(const std::string &accept_encoding)
+{
+    // 服务器的偏好顺序，q值相同时靠前的优先
+    static const EncodingType preference[] = {BROTLI, ZSTD, GZIP, DEFLATE};
+    static const int CODINGS = sizeof(preference) / sizeof(preference[0]);
+
+    double q[CODINGS];
+    for (int i = 0; i < CODINGS; ++i)
+        q[i] = -1; // -1表示客户端没有列出
+    double identity_q = -1;
+    double any_q = -1;
+
+    const char *p = accept_encoding.c_str();
+    const char *end = p + accept_encoding.size();
+    while (p < end)
+    {
+        // 每个元素形如 token [; q=value]，元素之间用逗号分隔
+        const char *item_end = (const char *)memchr(p, ',', end - p);
+        if (!item_end)
+            item_end = end;
+
+        const char *token = p;
+        while (token < item_end && (*token == ' ' || *token == '\t'))
+            ++token;
+        const char *token_end = token;
+        while (token_end < item_end && *token_end != ';' && *token_end != ' ' && *token_end != '\t')
+            ++token_end;
+
+        double weight = 1;
+        const char *param = (const char *)memchr(token_end, ';', item_end - token_end);
+        if (param)
+        {
+            ++param;
+            while (param < item_end && (*param == ' ' || *param == '\t'))
+                ++param;
+            const char *value_end = item_end;
+            while (value_end > param && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+                --value_end;
+            if (value_end - param >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+                weight = parse_qvalue(param + 2, value_end);
+        }
+        p = item_end + 1;
+
+        // q值非法的元素整个忽略
+        size_t len = token_end - token;
+        if (weight < 0 || len == 0)
+            continue;
+
+        std::string name(token, len);
+        if (strcasecmp(name.c_str(), "identity") == 0)
+            identity_q = weight;
+        else if (name == "*")
+            any_q = weight;
+        else
+        {
+            for (int i = 0; i < CODINGS; ++i)
+            {
+                // 只做完整的名称比较，x-gzip是gzip的别名
+                if (strcasecmp(name.c_str(), encoding_name(preference[i])) == 0 ||
+                    (preference[i] == GZIP && strcasecmp(name.c_str(), "x-gzip") == 0))
+                    q[i] = weight;
+            }
+        }
+    }
+
+    // 没有列出的编码按*处理；identity没有列出时总是可以接受，但优先级低于客户端列出的任何编码
+    if (identity_q < 0)
+        identity_q = any_q;
+
+    EncodingType best = NONE;
+    double best_q = 0;
+    for (int i = 0; i < CODINGS; ++i)
+    {
+        double weight = q[i] >= 0 ? q[i] : (any_q >= 0 ? any_q : 0);
+        if (is_supported(preference[i]) && weight > best_q)
+        {
+            best = preference[i];
+            best_q = weight;
+        }
+    }
+    // 客户端明确更偏好不压缩
+    if (best != NONE && best_q < identity_q)
+        return NONE;
+    return best;
+}
+
+bool ContentCompressor::compress(const std::string &content, EncodingType encoding_type, int quality)
 {
-    return compress(content.data(), content.size(), encoding_type);
+    return compress(content.data(), content.size(), encoding_type, quality);
 }
 
-bool ContentCompressor::compress(const char *data, size_t length, EncodingType encoding_type)
+bool ContentCompressor::compress(const char *data, size_t length, EncodingType encoding_type, int quality)
 {
     reset();
     // 根据客户端能接收的压缩格式选择指定的函数进行压缩
     switch (encoding_type)
     {
     case GZIP:
-        if (gzip_compress(data, length))
+        if (gzip_compress(data, length, quality < 0 ? Z_DEFAULT_COMPRESSION : quality))
         {
             current_encoding_ = GZIP;
             return true;
         }
         break;
     case DEFLATE:
-        if (deflate_compress(data, length))
+        if (deflate_compress(data, length, quality < 0 ? Z_DEFAULT_COMPRESSION : quality))
         {
             current_encoding_ = DEFLATE;
             return true;
         }
         break;
     case BROTLI:
-        if (brotli_compress(data, length))
+        if (brotli_compress(data, length, quality < 0 ? BROTLI_DEFAULT_QUALITY : quality))
         {
             current_encoding_ = BROTLI;
             return true;
         }
         break;
+    case ZSTD:
+        if (zstd_compress(data, length, quality))
+        {
+            current_encoding_ = ZSTD;
+            return true;
+        }
+        break;
     case NONE:
     default:
         break;
@@ -76,14 +227,14 @@ bool ContentCompressor::compress(const char *data, size_t length, EncodingType e
     return false;
 }
 
-bool ContentCompressor::gzip_compress(const char *data, size_t length)
+bool ContentCompressor::gzip_compress(const char *data, size_t length, int level)
 {
     // 定义一个 z_stream结构体，这是 zlib 库用于管理压缩状态的核心数据结构
     z_stream zs;
     memset(&zs, 0, sizeof(zs));
 
     // 初始化压缩流，MAX_WBITS + 16​​: 窗口大小位数为 MAX_WBITS(15)，+16 表示使用 gzip 头部和尾部格式
-    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+    if (deflateInit2(&zs, level, Z_DEFLATED,
                      MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
     {
         return false;
@@ -119,12 +270,12 @@ bool ContentCompressor::gzip_compress(const char *data, size_t length)
     return true;
 }
 
-bool ContentCompressor::deflate_compress(const char *data, size_t length)
+bool ContentCompressor::deflate_compress(const char *data, size_t length, int level)
 {
     z_stream zs;
     memset(&zs, 0, sizeof(zs));
 
-    if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK)
+    if (deflateInit(&zs, level) != Z_OK)
     {
         return false;
     }
@@ -154,7 +305,7 @@ bool ContentCompressor::deflate_compress(const char *data, size_t length)
     return true;
 }
 
-bool ContentCompressor::brotli_compress(const char *data, size_t length)
+bool ContentCompressor::brotli_compress(const char *data, size_t length, int quality)
 {
     // 估算最大压缩后大小
     size_t max_compressed_size = BrotliEncoderMaxCompressedSize(length);
@@ -163,7 +314,7 @@ bool ContentCompressor::brotli_compress(const char *data, size_t length)
     // 执行压缩
     size_t encoded_size = max_compressed_size;
     BROTLI_BOOL result = BrotliEncoderCompress(
-        BROTLI_DEFAULT_QUALITY, // 压缩质量 (0-11)
+        quality,                // 压缩质量 (0-11)
         BROTLI_DEFAULT_WINDOW,  // 窗口大小 (10-24)
         BROTLI_DEFAULT_MODE,    // 压缩模式
         length,
@@ -182,6 +333,27 @@ bool ContentCompressor::brotli_compress(const char *data, size_t length)
     return true;
 }
 
+bool ContentCompressor::zstd_compress(const char *data, size_t length, int level)
+{
+#ifdef HAVE_ZSTD
+    compressed_data_.resize(ZSTD_compressBound(length));
+    size_t encoded_size = ZSTD_compress(compressed_data_.data(), compressed_data_.size(),
+                                        data, length, level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+    if (ZSTD_isError(encoded_size))
+    {
+        compressed_data_.clear();
+        return false;
+    }
+    compressed_data_.resize(encoded_size);
+    return true;
+#else
+    (void)data;
+    (void)length;
+    (void)level;
+    return false;
+#endif
+}
+
 std::string ContentCompressor::content_encoding_header() const
 {
     switch (current_encoding_)
@@ -192,6 +364,8 @@ std::string ContentCompressor::content_encoding_header() const
         return "Content-Encoding: deflate\r\n";
     case BROTLI:
         return "Content-Encoding: br\r\n";
+    case ZSTD:
+        return "Content-Encoding: zstd\r\n";
     case NONE:
     default:
         return "";
@@ -7,6 +7,9 @@
 #include <set>
 #include <brotli/encode.h>
 #include <brotli/decode.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 class ContentCompressor
 {
@@ -16,19 +19,33 @@ public:
         GZIP,
         DEFLATE,
         BROTLI, // 新增 Brotli 类型
+        ZSTD,   // 需要编译时定义HAVE_ZSTD（make ZSTD=1）
         NONE
     };
 
     ContentCompressor();
     ~ContentCompressor();
 
+    // 后缀名是否属于可压缩的文本类型
+    static bool is_compressible(const std::string &file_extension);
+
+    // Content-Encoding中使用的编码名称
+    static const char *encoding_name(EncodingType encoding_type);
+
+    // 当前编译的版本是否支持该编码
+    static bool is_supported(EncodingType encoding_type);
+
+    // 解析Accept-Encoding（包括q值、*和identity），返回客户端最偏好的、服务器支持的编码；
+    // q值相同时按br、zstd、gzip、deflate的顺序选择，客户端更偏好不压缩时返回NONE
+    static EncodingType negotiate(const std::string &accept_encoding);
+
     // 通过检查文件的后缀名来判断是否应该压缩
     bool should_compress(const std::string &file_extension,
                          const std::string &accept_encoding) const;
 
-    // 执行压缩
-    bool compress(const std::string &content, EncodingType encoding_type);
-    bool compress(const char *data, size_t length, EncodingType encoding_type);
+    // 执行压缩，quality为-1时使用各算法的默认级别
+    bool compress(const std::string &content, EncodingType encoding_type, int quality = -1);
+    bool compress(const char *data, size_t length, EncodingType encoding_type, int quality = -1);
 
     // 获取压缩后的数据
     const std::vector<char> &compressed_data() const { return compressed_data_; }
@@ -47,10 +64,11 @@ private:
     EncodingType current_encoding_;
 
     // 内部压缩实现
-    bool gzip_compress(const char *data, size_t length);
-    bool deflate_compress(const char *data, size_t length);
+    bool gzip_compress(const char *data, size_t length, int level);
+    bool deflate_compress(const char *data, size_t length, int level);
     // brotli压缩
-    bool brotli_compress(const char *data, size_t length);
+    bool brotli_compress(const char *data, size_t length, int quality);
+    bool zstd_compress(const char *data, size_t length, int level);
 
     // 支持的压缩类型
     static const std::set<std::string> compressible_types_;
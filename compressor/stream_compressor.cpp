@@ -0,0 +1,173 @@
+#include "stream_compressor.h"
+#include <cstring>
+
+// 流式压缩时brotli的质量不超过5，并且使用较小的窗口，限制每个连接的编码器内存
+static const int STREAM_BROTLI_QUALITY = 5;
+static const int STREAM_BROTLI_WINDOW = 18;
+
+StreamCompressor::StreamCompressor()
+    : encoding_(ContentCompressor::NONE), brotli_(NULL)
+{
+#ifdef HAVE_ZSTD
+    zstd_ = NULL;
+#endif
+    memset(&zs_, 0, sizeof(zs_));
+}
+
+StreamCompressor::~StreamCompressor()
+{
+    reset();
+}
+
+bool StreamCompressor::begin(ContentCompressor::EncodingType encoding_type, int quality)
+{
+    reset();
+    int level = quality < 0 ? Z_DEFAULT_COMPRESSION : quality;
+    switch (encoding_type)
+    {
+    case ContentCompressor::GZIP:
+        // MAX_WBITS + 16 表示使用 gzip 头部和尾部格式
+        if (deflateInit2(&zs_, level, Z_DEFLATED,
+                         MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        break;
+    case ContentCompressor::DEFLATE:
+        if (deflateInit(&zs_, level) != Z_OK)
+            return false;
+        break;
+    case ContentCompressor::BROTLI:
+        brotli_ = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+        if (!brotli_)
+            return false;
+        BrotliEncoderSetParameter(brotli_, BROTLI_PARAM_QUALITY,
+                                  quality < 0 || quality > STREAM_BROTLI_QUALITY ? STREAM_BROTLI_QUALITY : quality);
+        BrotliEncoderSetParameter(brotli_, BROTLI_PARAM_LGWIN, STREAM_BROTLI_WINDOW);
+        break;
+#ifdef HAVE_ZSTD
+    case ContentCompressor::ZSTD:
+        zstd_ = ZSTD_createCCtx();
+        if (!zstd_)
+            return false;
+        ZSTD_CCtx_setParameter(zstd_, ZSTD_c_compressionLevel, quality < 0 ? ZSTD_CLEVEL_DEFAULT : quality);
+        break;
+#endif
+    case ContentCompressor::NONE:
+    default:
+        return false;
+    }
+    encoding_ = encoding_type;
+    return true;
+}
+
+bool StreamCompressor::compress(const char *data, size_t length, bool finish, std::vector<char> &out)
+{
+    switch (encoding_)
+    {
+    case ContentCompressor::GZIP:
+    case ContentCompressor::DEFLATE:
+        return zlib_compress(data, length, finish, out);
+    case ContentCompressor::BROTLI:
+        return brotli_compress(data, length, finish, out);
+    case ContentCompressor::ZSTD:
+        return zstd_compress(data, length, finish, out);
+    case ContentCompressor::NONE:
+    default:
+        return false;
+    }
+}
+
+bool StreamCompressor::zlib_compress(const char *data, size_t length, bool finish, std::vector<char> &out)
+{
+    zs_.next_in = (Bytef *)data;
+    zs_.avail_in = length;
+
+    // Z_SYNC_FLUSH保证这一段输入对应的输出全部吐出，客户端收到一个chunk就能解压
+    int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+    char outbuffer[16384];
+    int ret;
+    do
+    {
+        zs_.next_out = (Bytef *)outbuffer;
+        zs_.avail_out = sizeof(outbuffer);
+        ret = deflate(&zs_, flush);
+        if (ret == Z_STREAM_ERROR)
+            return false;
+        size_t have = sizeof(outbuffer) - zs_.avail_out;
+        out.insert(out.end(), outbuffer, outbuffer + have);
+    } while (zs_.avail_out == 0);
+
+    return !finish || ret == Z_STREAM_END;
+}
+
+bool StreamCompressor::brotli_compress(const char *data, size_t length, bool finish, std::vector<char> &out)
+{
+    size_t available_in = length;
+    const uint8_t *next_in = reinterpret_cast<const uint8_t *>(data);
+    BrotliEncoderOperation op = finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+
+    uint8_t outbuffer[16384];
+    while (true)
+    {
+        size_t available_out = sizeof(outbuffer);
+        uint8_t *next_out = outbuffer;
+        if (!BrotliEncoderCompressStream(brotli_, op, &available_in, &next_in,
+                                         &available_out, &next_out, NULL))
+            return false;
+        out.insert(out.end(), (char *)outbuffer, (char *)outbuffer + (sizeof(outbuffer) - available_out));
+
+        if (available_in == 0 && !BrotliEncoderHasMoreOutput(brotli_))
+        {
+            if (!finish || BrotliEncoderIsFinished(brotli_))
+                break;
+        }
+    }
+    return true;
+}
+
+bool StreamCompressor::zstd_compress(const char *data, size_t length, bool finish, std::vector<char> &out)
+{
+#ifdef HAVE_ZSTD
+    ZSTD_inBuffer input = {data, length, 0};
+    ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_flush;
+    char outbuffer[16384];
+    size_t remaining;
+    do
+    {
+        ZSTD_outBuffer output = {outbuffer, sizeof(outbuffer), 0};
+        // 返回值为内部缓冲区中还没有输出的字节数，为0时这一段已经全部flush
+        remaining = ZSTD_compressStream2(zstd_, &output, &input, mode);
+        if (ZSTD_isError(remaining))
+            return false;
+        out.insert(out.end(), outbuffer, outbuffer + output.pos);
+    } while (remaining != 0 || input.pos < input.size);
+    return true;
+#else
+    (void)data;
+    (void)length;
+    (void)finish;
+    (void)out;
+    return false;
+#endif
+}
+
+void StreamCompressor::reset()
+{
+    if (encoding_ == ContentCompressor::GZIP || encoding_ == ContentCompressor::DEFLATE)
+    {
+        deflateEnd(&zs_);
+        memset(&zs_, 0, sizeof(zs_));
+    }
+    if (brotli_)
+    {
+        BrotliEncoderDestroyInstance(brotli_);
+        brotli_ = NULL;
+    }
+#ifdef HAVE_ZSTD
+    if (zstd_)
+    {
+        ZSTD_freeCCtx(zstd_);
+        zstd_ = NULL;
+    }
+#endif
+    encoding_ = ContentCompressor::NONE;
+}
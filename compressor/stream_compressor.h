@@ -0,0 +1,50 @@
+#ifndef STREAM_COMPRESSOR_H
+#define STREAM_COMPRESSOR_H
+
+/*************************************************************
+*流式压缩：大文件按固定大小的窗口分段压缩，每段压缩完立即flush，
+*压缩结果作为一个chunk发送（Transfer-Encoding: chunked）
+*   - 不需要在内存中保存完整的压缩结果，首字节不用等整个文件压缩完
+*   - 每个连接的内存只有压缩器状态和一个窗口的输出
+**************************************************************/
+
+#include <vector>
+#include <zlib.h>
+#include <brotli/encode.h>
+
+#include "content_compressor.h"
+
+class StreamCompressor
+{
+public:
+    StreamCompressor();
+    ~StreamCompressor();
+
+    StreamCompressor(const StreamCompressor &) = delete;
+    StreamCompressor &operator=(const StreamCompressor &) = delete;
+
+    // 开始一个新的压缩流，quality为-1时使用默认级别
+    bool begin(ContentCompressor::EncodingType encoding_type, int quality = -1);
+
+    // 压缩[data, data + length)并flush，finish为true时结束压缩流，压缩结果追加到out
+    bool compress(const char *data, size_t length, bool finish, std::vector<char> &out);
+
+    // 释放压缩器状态
+    void reset();
+
+    bool active() const { return encoding_ != ContentCompressor::NONE; }
+
+private:
+    bool zlib_compress(const char *data, size_t length, bool finish, std::vector<char> &out);
+    bool brotli_compress(const char *data, size_t length, bool finish, std::vector<char> &out);
+    bool zstd_compress(const char *data, size_t length, bool finish, std::vector<char> &out);
+
+    ContentCompressor::EncodingType encoding_;
+    z_stream zs_;
+    BrotliEncoderState *brotli_;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd_;
+#endif
+};
+
+#endif // STREAM_COMPRESSOR_H
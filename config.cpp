@@ -41,12 +41,37 @@ Config::Config()
 
     // 是否使用压缩算法
     is_compress = true;
+
+    // 从反应堆数量,默认0(只有一个事件循环)
+    reactor_num = 0;
+
+    // SO_REUSEPORT多监听socket,默认不开启
+    reuse_port = false;
+
+    // listen队列长度,默认1024
+    backlog = 1024;
+
+    // 线程池任务队列,默认链表+互斥锁
+    queue_model = 0;
+
+    // 推理线程池,默认2个线程,最多排队8个请求
+    infer_thread_num = 2;
+    infer_queue = 8;
+
+    // 定时器容器,默认最小堆
+    timer_model = 0;
+
+    // 静态文件缓存,默认64MB
+    file_cache_mb = 64;
+
+    // 内核TLS（kTLS）卸载,默认不开启
+    ktls = false;
 }
 
 void Config::parse_arg(int argc, char *argv[])
 {
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:r:u:b:q:i:j:w:f:k:";
     while ((opt = getopt(argc, argv, str)) != -1)
     {
         switch (opt)
@@ -91,6 +116,51 @@ void Config::parse_arg(int argc, char *argv[])
             actor_model = atoi(optarg);
             break;
         }
+        case 'r':
+        {
+            reactor_num = atoi(optarg);
+            break;
+        }
+        case 'u':
+        {
+            reuse_port = atoi(optarg) != 0;
+            break;
+        }
+        case 'b':
+        {
+            backlog = atoi(optarg);
+            break;
+        }
+        case 'q':
+        {
+            queue_model = atoi(optarg);
+            break;
+        }
+        case 'i':
+        {
+            infer_thread_num = atoi(optarg);
+            break;
+        }
+        case 'j':
+        {
+            infer_queue = atoi(optarg);
+            break;
+        }
+        case 'w':
+        {
+            timer_model = atoi(optarg);
+            break;
+        }
+        case 'f':
+        {
+            file_cache_mb = atoi(optarg);
+            break;
+        }
+        case 'k':
+        {
+            ktls = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
@@ -52,6 +52,33 @@ public:
     std::string cert_file;
 
     bool is_compress;
+
+    // 从反应堆（子事件循环）线程数量，0表示单个事件循环
+    int reactor_num;
+
+    // 是否为每个从反应堆开启SO_REUSEPORT监听socket
+    bool reuse_port;
+
+    // listen全连接队列长度
+    int backlog;
+
+    // 线程池任务队列实现（0-链表+互斥锁，1-无锁环形队列，2-每线程双端队列+任务窃取）
+    int queue_model;
+
+    // 推理请求（/10 /11 /12）独立线程池的线程数，0表示与静态请求共用线程池
+    int infer_thread_num;
+
+    // 推理线程池最多排队的请求数，超过之后直接返回503
+    int infer_queue;
+
+    // 定时器容器（0-最小堆，1-分层时间轮）
+    int timer_model;
+
+    // 静态文件缓存大小（MB），0表示关闭
+    int file_cache_mb;
+
+    // 内核TLS（kTLS）：TLS记录由内核加密，静态文件可以零拷贝发送（需要OpenSSL 3和Linux tls模块）
+    bool ktls;
 };
 
 #endif
\ No newline at end of file
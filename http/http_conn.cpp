@@ -3,6 +3,8 @@
 #include <mysql/mysql.h>
 #include <fstream>
 
+#include "../threadpool/completion_queue.h"
+
 // 定义http响应的一些状态信息
 const char *ok_200_title = "OK";
 const char *error_400_title = "Bad Request";
@@ -17,6 +19,12 @@ const char *error_404_form = "The requested file was not found on this server.\n
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
+const char *error_501_title = "Not Implemented";
+const char *error_501_form = "Transfer-Encoding of request bodies is not supported.\n";
+
+const char *error_503_title = "Service Unavailable";
+const char *error_503_form = "The inference service is busy, please retry later.\n";
+
 locker m_lock;
 map<std::string, std::string> users;
 
@@ -24,6 +32,50 @@ map<std::string, std::string> users;
 map<std::string, session_info> http_conn::sessions;
 locker http_conn::session_lock;
 
+// 进程退出时slab中的连接对象析构会归还缓冲区，先构造BufferPool，保证它比slab晚析构
+object_pool<http_conn> &http_conn::conn_pool()
+{
+    BufferPool::instance();
+    static object_pool<http_conn> pool;
+    return pool;
+}
+
+http_conn *http_conn::create()
+{
+    http_conn *conn = conn_pool().acquire();
+    conn->m_sockfd = -1;
+    conn->m_refs.store(1, std::memory_order_relaxed);
+    return conn;
+}
+
+/*连接关闭（超时、对端关闭或读写失败）时由事件循环调用，已经从epoll上删除。
+  工作线程或推理线程可能还在处理这个连接，这时只减掉事件循环的引用，
+  socket和对象等最后一个任务release时再回收，避免fd和对象被新连接复用*/
+void http_conn::recycle(http_conn *conn)
+{
+    release(conn);
+}
+
+// 对象留在slab中等待下一个连接，先关闭socket，释放它占用的文件、缓冲区和TLS状态
+void http_conn::release(http_conn *conn)
+{
+    if (conn->m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    if (conn->m_sockfd != -1)
+    {
+        close(conn->m_sockfd);
+        conn->m_sockfd = -1;
+    }
+    conn->unmap();
+    conn->release_buffers();
+    conn->m_upload_sink.abort();
+    conn->ssl_wrapper_.reset();
+    conn->m_cls.reset();
+    conn->m_obj.reset();
+    conn->m_seg.reset();
+    conn_pool().release(conn);
+}
+
 void http_conn::initmysql_result(connection_pool *connPool)
 {
     // 先从连接池中取一个连接，用于后面对用户表的初始化
@@ -83,8 +135,8 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
     */
     if (one_shot)
         event.events |= EPOLLONESHOT;
+    // 连接fd在accept4时已经是非阻塞的，这里不需要再调用fcntl
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setnonblocking(fd);
 }
 
 // 从内核时间表删除描述符
@@ -112,39 +164,34 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
+std::atomic<int> http_conn::m_user_count(0);
 
-// 关闭连接，关闭一个连接，客户总量减一
+// 工作线程中关闭连接：只把fd从epoll上移除，再由事件循环通过完成队列删除定时器并回收连接对象（和超时关闭一样走cb_func，
+// 客户总量在那里减一），socket由最后一个引用release时关闭，工作线程还持有引用时fd不会被新连接复用
 void http_conn::close_conn(bool real_close)
 {
-    // 关闭连接以及从epoll上移除事件
     if (real_close && (m_sockfd != -1))
     {
         if (ssl_wrapper_)
-        {
             ssl_wrapper_->shutdown();
-            ssl_wrapper_.reset(); // 释放SSLWrapper
-        }
         monitor_adapter_.on_connection_end();
         printf("close %d\n", m_sockfd);
-        // 将对应的fd从epoll上面移除
-        removefd(m_epollfd, m_sockfd);
-        m_sockfd = -1;
-        m_user_count--;
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_sockfd, 0);
+        timer_flag = 1;
     }
 }
 
 // 初始化连接,外部调用初始化套接字地址
-void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
+void http_conn::init(int sockfd, const sockaddr_in &addr, int epollfd, char *root, int TRIGMode,
                      int close_log, std::string user, std::string passwd,
                      std::string sqlname, bool use_ssl, std::shared_ptr<OpenSSLContext> opensslContext_,
                      std::shared_ptr<SSLWrapper> ssl_wrapper, bool is_compress)
 {
     m_sockfd = sockfd;
     m_address = addr;
+    m_epollfd = epollfd;
 
-    // 将已经建立的连接注册到epoll中
+    // 将已经建立的连接注册到所属事件循环的epoll中
     addfd(m_epollfd, sockfd, true, m_TRIGMode);
     m_user_count++;
 
@@ -160,22 +207,9 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
     ssl_wrapper_ = ssl_wrapper;
     printf("%s %d http initialize successfully!\n", __FILE__, __LINE__);
 
+    // TLS握手由事件循环在socket就绪时调用do_handshake逐步完成
     if (use_ssl_)
-    {
-        try
-        {
-            is_connect_success = true;
-            printf("%s %d SSL/TLS connect successfully!\n", __FILE__, __LINE__);
-            LOG_ERROR("%s %d SSL/TLS connect successfully!", __FILE__, __LINE__);
-        }
-        catch (const std::exception &e)
-        {
-            LOG_ERROR("SSL initialization failed: %s", e.what());
-            is_connect_success = false;
-            close_conn();
-            return;
-        }
-    }
+        m_handshake_start = std::chrono::steady_clock::now();
 
     strcpy(sql_user, user.c_str());
     strcpy(sql_passwd, passwd.c_str());
@@ -192,10 +226,61 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
     }
 }
 
+bool http_conn::do_handshake()
+{
+    if (!ssl_wrapper_)
+        return false;
+
+    switch (ssl_wrapper_->handshake())
+    {
+    case SSLWrapper::HANDSHAKE_DONE:
+    {
+        is_connect_success = true;
+        uint64_t duration_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now() - m_handshake_start)
+                                   .count();
+        bool resumed = SSL_session_reused(ssl_wrapper_->getSSL()) == 1;
+        MonitorSystem::instance().record_ssl_handshake(true, resumed, duration_us);
+        LOG_INFO("%s %d SSL/TLS connect successfully! protocol: %s, cipher: %s, resumed: %d", __FILE__, __LINE__,
+                 SSL_get_version(ssl_wrapper_->getSSL()), SSL_get_cipher(ssl_wrapper_->getSSL()), resumed);
+        // 握手完成，等待客户端发送请求
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        return true;
+    }
+    case SSLWrapper::HANDSHAKE_WANT_READ:
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        return true;
+    case SSLWrapper::HANDSHAKE_WANT_WRITE:
+        modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+        return true;
+    case SSLWrapper::HANDSHAKE_FAILED:
+    default:
+        MonitorSystem::instance().record_ssl_handshake(false, false, 0);
+        LOG_ERROR("%s %d SSL/TLS handshake failed!", __FILE__, __LINE__);
+        return false;
+    }
+}
+
+// reactor模式下工作线程处理完之后通知连接所属的事件循环
+void http_conn::post_completion()
+{
+    if (m_cq)
+        m_cq->post(m_sockfd);
+}
+
 // 初始化新接受的连接
-// check_state默认为分析请求行状态
 void http_conn::init()
 {
+    reset_request();
+    // 上一个请求用过的缓冲区还回去，收到下一个请求的数据时再借
+    release_buffers();
+}
+
+// check_state默认为分析请求行状态
+void http_conn::reset_request()
+{
+    // 上一个连接在发送文件的过程中被关闭时，释放遗留的映射区和文件描述符
+    unmap();
     mysql = NULL;
     bytes_to_send = 0;
     bytes_have_send = 0;
@@ -205,17 +290,28 @@ void http_conn::init()
     m_url = 0;
     m_version = 0;
     m_content_length = 0;
+    m_has_content_length = false;
     m_host = 0;
     m_start_line = 0;
     m_checked_idx = 0;
+    m_line_colon = -1;
+    m_request_end = 0;
+    m_request_end_char = '\0';
     m_read_idx = 0;
     m_write_idx = 0;
     cgi = 0; // 是否启用POST
     m_state = 0;
     timer_flag = 0;
-    improv = 0;
     m_header_value = "";
     m_upload_filename = NULL;
+    m_method_override = NULL;
+    chunk_header = 0;
+    total_header = 0;
+    m_file_size = 0;
+    // 上一个请求没有收完的上传文件
+    m_upload_sink.abort();
+    m_body_received = 0;
+    m_read_error = NO_REQUEST;
     m_session_id = "";
     m_is_logged_in = false;
     m_has_session = false;
@@ -227,17 +323,169 @@ void http_conn::init()
     conf_threshold = 0;
     is_response_result = false;
     is_objectDetect = false;
-    compressor_.reset();
-    is_compress_ = false;
+    is_segmentation = false;
+    // 推理结果已经写进上一个响应，释放模型和图像
+    m_cls.reset();
+    m_obj.reset();
+    m_seg.reset();
+    m_accept_encoding.clear();
+    m_encoding = ContentCompressor::NONE;
+    m_sidecar_encoding = ContentCompressor::NONE;
     is_admin_system = false;
 
     monitor_adapter_.on_connection_start();
-
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
 }
 
+void http_conn::next_request(bool keep_output)
+{
+    int begin = m_request_end;
+    int read_idx = m_read_idx;
+    int write_idx = m_write_idx;
+    char end_char = m_request_end_char;
+    reset_request();
+
+    if (keep_output)
+        m_write_idx = write_idx;
+    else
+        release_write_buf();
+
+    if (read_idx > begin)
+    {
+        m_read_buf[begin] = end_char;
+        memmove(m_read_buf, m_read_buf + begin, read_idx - begin);
+        m_read_idx = read_idx - begin;
+        m_read_buf[m_read_idx] = '\0';
+    }
+    else
+        release_read_buf();
+}
+
+void http_conn::finish_request(int end)
+{
+    m_check_state = CHECK_STATE_DONE;
+    m_request_end = end;
+    // 请求末尾写'\0'，包体（登录、注册的表单）可以直接当作字符串使用
+    m_request_end_char = m_read_buf[end];
+    m_read_buf[end] = '\0';
+}
+
+bool http_conn::has_pending_request() const
+{
+    /*下一个请求还没有开始解析；已经解析了一部分的请求等待读事件。
+      写缓冲区中还有没发完的响应时（write遇到EAGAIN）不能处理，否则新的响应会覆盖它们，
+      等finish_response发完重置之后再由调用者处理*/
+    return bytes_to_send == 0 && m_check_state == CHECK_STATE_REQUESTLINE && m_checked_idx == 0 && m_read_idx > 0;
+}
+
+bool http_conn::grow_read_buf(int size)
+{
+    if (size <= m_read_size)
+        return true;
+    if (size > READ_BUFFER_SIZE)
+        return false;
+    size_t capacity;
+    char *buf = BufferPool::instance().acquire(size, capacity);
+    if (!buf)
+        return false;
+
+    if (m_read_buf)
+    {
+        memcpy(buf, m_read_buf, m_read_idx);
+        // 请求行和请求头的解析结果直接指向读缓冲区
+        char **fields[] = {&m_url, &m_version, &m_host, &m_string,
+                           &m_method_override, &m_upload_filename, &model_name};
+        uintptr_t begin = (uintptr_t)m_read_buf;
+        uintptr_t end = begin + m_read_size;
+        for (char **field : fields)
+        {
+            uintptr_t p = (uintptr_t)*field;
+            if (p >= begin && p < end)
+                *field = buf + (p - begin);
+        }
+        BufferPool::instance().release(m_read_buf, m_read_size);
+    }
+    m_read_buf = buf;
+    m_read_size = capacity;
+    m_read_buf[m_read_idx] = '\0';
+    return true;
+}
+
+bool http_conn::grow_write_buf(int size)
+{
+    if (size <= m_write_size)
+        return true;
+    if (size > WRITE_BUFFER_SIZE)
+        return false;
+    size_t capacity;
+    char *buf = BufferPool::instance().acquire(size, capacity);
+    if (!buf)
+        return false;
+
+    if (m_write_buf)
+    {
+        memcpy(buf, m_write_buf, m_write_idx);
+        BufferPool::instance().release(m_write_buf, m_write_size);
+    }
+    m_write_buf = buf;
+    m_write_size = capacity;
+    m_write_buf[m_write_idx] = '\0';
+    return true;
+}
+
+bool http_conn::reserve_read_buf()
+{
+    // 保留一个字节放'\0'
+    if (m_read_idx + 1 < m_read_size)
+        return true;
+    // 上传包体攒够一个窗口就写进文件，不再扩大缓冲区
+    if (m_upload_sink.is_open() && m_read_size >= m_checked_idx + UPLOAD_WINDOW)
+        return false;
+    long size = m_read_size > 0 ? m_read_size * 2 : (long)BufferPool::MIN_BUFFER_SIZE;
+    // 请求头已经解析完，按Content-Length一次扩大到能装下整个包体
+    if (m_check_state == CHECK_STATE_CONTENT && !m_upload_sink.is_open() &&
+        m_checked_idx + m_content_length + 1 > size)
+        size = m_checked_idx + m_content_length + 1;
+    if (size > READ_BUFFER_SIZE)
+        size = READ_BUFFER_SIZE;
+    return m_read_idx + 1 < size && grow_read_buf((int)size);
+}
+
+bool http_conn::make_read_room()
+{
+    if (reserve_read_buf())
+        return true;
+    // 请求头和已经收到的包体先解析掉：上传包体写进文件后读缓冲区就空出来了
+    HTTP_CODE ret = parse_request();
+    if (ret == NO_REQUEST && reserve_read_buf())
+        return true;
+    // 请求已经完整（CHECK_STATE_DONE）时不再读取；出错或者请求太大时记下原因，
+    // 由process_read返回，客户端收到错误响应而不是直接被关闭连接
+    if (ret != GET_REQUEST)
+        m_read_error = ret == NO_REQUEST ? BAD_REQUEST : ret;
+    return false;
+}
+
+void http_conn::release_buffers()
+{
+    release_read_buf();
+    release_write_buf();
+}
+
+void http_conn::release_read_buf()
+{
+    BufferPool::instance().release(m_read_buf, m_read_size);
+    m_read_buf = NULL;
+    m_read_size = 0;
+}
+
+void http_conn::release_write_buf()
+{
+    BufferPool::instance().release(m_write_buf, m_write_size);
+    m_write_buf = NULL;
+    m_write_size = 0;
+}
+
 /**
  * @brief 生成安全的随机Session ID
  *
@@ -381,59 +629,62 @@ void http_conn::cleanup_expired_sessions()
 */
 http_conn::LINE_STATUS http_conn::parse_line()
 {
-    char temp;
-    // 在调用read_once的时候就已经讲数据一次读取出来了，m_read_idx表示当前读取数据大小
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx)
-    {
-        // temp为将要分析的字节
-        temp = m_read_buf[m_checked_idx];
-        // printf("start parse line %s %d temp = %c\n", __FILE__, __LINE__, temp);
+    // 开始扫描新的一行
+    if (m_checked_idx == m_start_line)
+        m_line_colon = -1;
+    if (m_checked_idx >= m_read_idx)
+        return LINE_OPEN;
+
+    // 在调用read_once的时候就已经讲数据一次读取出来了，m_read_idx表示当前读取数据大小；
+    // 一次扫描找到行结束符，同时记下行内第一个冒号的位置给parse_headers使用
+    const char *colon = NULL;
+    const char *eol = scan_line(m_read_buf + m_checked_idx, m_read_buf + m_read_idx,
+                                m_line_colon < 0 ? &colon : NULL);
+    if (colon)
+        m_line_colon = colon - m_read_buf;
+    m_checked_idx = eol - m_read_buf;
 
-        // 如果当前是\r字符，则有可能会读取到完整行
-        if (temp == '\r')
-        {
-
-            // 下一个字符达到了buffer结尾，则接收不完整，需要继续接收
-            if ((m_checked_idx + 1) == m_read_idx)
-                return LINE_OPEN;
-            // 下一个字符是\n，将\r\n改为\0\0,表示读取了完整的一行
-            else if (m_read_buf[m_checked_idx + 1] == '\n')
-            {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            // 如果都不符合，则返回语法错误
-            return LINE_BAD;
-        }
+    // 并没有找到\r\n，需要继续接收
+    if (m_checked_idx == m_read_idx)
+        return LINE_OPEN;
 
-        // 如果当前字符是\n，也有可能读取到完整行
-        // 一般是上次读取到\r就到buffer末尾了，没有接收完整，再次接收时会出现这种情况
-        else if (temp == '\n')
+    // 如果当前是\r字符，则有可能会读取到完整行
+    if (*eol == '\r')
+    {
+        // 下一个字符达到了buffer结尾，则接收不完整，需要继续接收
+        if ((m_checked_idx + 1) == m_read_idx)
+            return LINE_OPEN;
+        // 下一个字符是\n，将\r\n改为\0\0,表示读取了完整的一行
+        else if (m_read_buf[m_checked_idx + 1] == '\n')
         {
-            // 前一个字符是\r，则接收完整
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
-            {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
+        // 如果都不符合，则返回语法错误
+        return LINE_BAD;
     }
 
-    // 并没有找到\r\n，需要继续接收
-    return LINE_OPEN;
+    // 如果当前字符是\n，也有可能读取到完整行
+    // 一般是上次读取到\r就到buffer末尾了，没有接收完整，再次接收时会出现这种情况
+    if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
+    {
+        m_read_buf[m_checked_idx - 1] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
 // 循环读取客户数据，直到无数据可读或对方关闭连接
 // 非阻塞ET工作模式下，需要一次性将数据读完
 bool http_conn::read_once()
 {
-    // 判断有无数据可读
-    if (m_read_idx >= READ_BUFFER_SIZE)
+    // 缓冲区已满（或者还没有借缓冲区）时先扩大或者先解析掉已经收到的数据，
+    // 腾不出空间时请求已经完整或者出错，都交给process处理
+    if (!make_read_room())
     {
-        return false;
+        return true;
     }
     int bytes_read = 0;
 
@@ -445,7 +696,7 @@ bool http_conn::read_once()
             try
             {
                 bytes_read = ssl_wrapper_->read(m_read_buf + m_read_idx,
-                                                READ_BUFFER_SIZE - m_read_idx);
+                                                m_read_size - 1 - m_read_idx);
             }
             catch (const std::exception &e)
             {
@@ -456,21 +707,23 @@ bool http_conn::read_once()
         else
         {
             bytes_read = recv(m_sockfd, m_read_buf + m_read_idx,
-                              READ_BUFFER_SIZE - m_read_idx, 0);
+                              m_read_size - 1 - m_read_idx, 0);
         }
         // printf("%s %d %s\n", __FILE__, __LINE__, m_read_buf);
 
-        if (bytes_read > 0)
+        // SSL连接上只收到了半个TLS记录，等待剩余的数据
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
         {
-            monitor_adapter_.on_data_read(bytes_read);
+            return true;
         }
-
-        m_read_idx += bytes_read;
-
         if (bytes_read <= 0)
         {
             return false;
         }
+
+        monitor_adapter_.on_data_read(bytes_read);
+        m_read_idx += bytes_read;
+        m_read_buf[m_read_idx] = '\0';
         // printf("%s %d  recv data is successfully\n", __FILE__, __LINE__);
         return true;
     }
@@ -480,12 +733,14 @@ bool http_conn::read_once()
         // ET模式只通知一次，因此要一次性将缓冲区中所有数据都读取出来
         while (true)
         {
+            if (!make_read_room())
+                return true;
             if (use_ssl_ && is_connect_success)
             {
                 try
                 {
                     bytes_read = ssl_wrapper_->read(m_read_buf + m_read_idx,
-                                                    READ_BUFFER_SIZE - m_read_idx);
+                                                    m_read_size - 1 - m_read_idx);
                 }
                 catch (const std::exception &e)
                 {
@@ -496,7 +751,7 @@ bool http_conn::read_once()
             else
             {
                 bytes_read = recv(m_sockfd, m_read_buf + m_read_idx,
-                                  READ_BUFFER_SIZE - m_read_idx, 0);
+                                  m_read_size - 1 - m_read_idx, 0);
             }
 
             if (bytes_read == -1)
@@ -510,6 +765,7 @@ bool http_conn::read_once()
                 return false;
             }
             m_read_idx += bytes_read;
+            m_read_buf[m_read_idx] = '\0';
         }
         return true;
     }
@@ -552,6 +808,8 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     m_version += strspn(m_version, " \t");
     if (strcasecmp(m_version, "HTTP/1.1") != 0) // 只支持HTTP/1.1
         return BAD_REQUEST;
+    // HTTP/1.1默认是长连接，客户端可以连续发送多个请求（流水线）
+    m_linger = true;
     // 处理http://前缀
     if (strncasecmp(m_url, "http://", 7) == 0)
     {
@@ -583,118 +841,134 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
     // 若是，则表示当前处理的是空行，若不是，则表示当前处理的是请求头。
     if (text[0] == '\0')
     {
-        if (m_content_length != 0)
-        {
-            // 表示当前已经解析完头部信息，下一步对内容进行解析
-            m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST;
-        }
-        return GET_REQUEST;
+        // 表示当前已经解析完头部信息，有包体时下一步对内容进行解析
+        return begin_content();
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+    // parse_line扫描行结束符时已经找到了冒号，冒号之前是头部名称，之后跳过空白符是值
+    if (m_line_colon < 0)
+    {
+        LOG_INFO("oop!unknow header: %s", text);
+        return NO_REQUEST;
+    }
+    char *colon = m_read_buf + m_line_colon;
+    /*名称前后有空白（包括以空白开头的折行）时，前面的代理可能和这里对头部名称的理解不一样，
+      比如把"Transfer-Encoding :"当成Transfer-Encoding，直接拒绝*/
+    if (colon == text || text[0] == ' ' || text[0] == '\t' || colon[-1] == ' ' || colon[-1] == '\t')
+        return AMBIGUOUS_REQUEST;
+    char *value = colon + 1;
+    value += strspn(value, " \t"); // 跳过空白符
+
+    switch (classify_header(text, colon - text))
+    {
+    case HEADER_CONNECTION:
     {
-        text += 11;
-        text += strspn(text, " \t"); // 跳过空白符
         // 是否采用HTTP长连接
-        if (strcasecmp(text, "keep-alive") == 0)
+        if (strcasecmp(value, "keep-alive") == 0)
         {
             m_linger = true; // 保持长连接（客户端请求）
         }
+        else if (strcasecmp(value, "close") == 0)
+        {
+            m_linger = false;
+        }
+        break;
     }
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
-    {
-        text += 15;
-        text += strspn(text, " \t");
+    case HEADER_CONTENT_LENGTH:
+    {
+        /*流水线请求按Content-Length找下一个请求的起点，长度必须唯一：
+          出现多次（即使值相同）或者不是纯数字时拒绝，防止请求走私*/
+        if (m_has_content_length)
+            return AMBIGUOUS_REQUEST;
+        m_has_content_length = true;
+        char *end = value;
+        while (*end >= '0' && *end <= '9')
+            ++end;
+        if (end == value || end - value > 18 || end[strspn(end, " \t")] != '\0')
+            return AMBIGUOUS_REQUEST;
         // 获得文本长度
-        m_content_length = atol(text);
+        m_content_length = atol(value);
+        break;
+    }
+    case HEADER_TRANSFER_ENCODING:
+    {
+        // 不支持分块的请求包体，继续解析会把包体当成下一个请求
+        LOG_INFO("Transfer-Encoding of request body not supported: %s", value);
+        return NOT_IMPLEMENTED;
     }
-    else if (strncasecmp(text, "Host:", 5) == 0)
+    case HEADER_HOST:
     {
-        text += 5;
-        text += strspn(text, " \t");
         // 主机名，比如www.wrox.com
-        m_host = text;
+        m_host = value;
+        break;
     }
-    else if (strncasecmp(text, "X-HTTP-Method-Override:", 22) == 0)
+    case HEADER_METHOD_OVERRIDE:
     {
-        text += 22;
-        // 跳过": ""
-        text += 2;
-        text += strspn(text, " \t");
         // 存储方法覆盖值
-        m_method_override = text;
-        LOG_INFO("Got method override: %s", text);
-    } // 添加分块上传相关头部解析
-    else if (strncasecmp(text, "X-Chunk-Number:", 15) == 0)
-    {
-        text += 15;
-        text += strspn(text, " \t");
-        chunk_header = atoi(text);
+        m_method_override = value;
+        LOG_INFO("Got method override: %s", value);
+        break;
+    }
+    // 分块上传相关头部
+    case HEADER_CHUNK_NUMBER:
+    {
+        chunk_header = atoi(value);
         LOG_INFO("Got chunk number: %d", chunk_header);
+        break;
     }
-    else if (strncasecmp(text, "X-Total-Chunks:", 15) == 0)
+    case HEADER_TOTAL_CHUNKS:
     {
-        text += 15;
-        text += strspn(text, " \t");
-        total_header = atoi(text);
+        total_header = atoi(value);
         LOG_INFO("Got total chunks: %d", total_header);
+        break;
     }
-    else if (strncasecmp(text, "X-File-Name:", 12) == 0)
+    case HEADER_FILE_NAME:
     {
-        text += 12;
-        text += strspn(text, " \t");
-        m_upload_filename = text;
+        m_upload_filename = value;
         LOG_INFO("Got upload filename: %s", m_upload_filename);
+        break;
     }
-    else if (strncasecmp(text, "X-File-Size:", 12) == 0)
+    case HEADER_FILE_SIZE:
     {
-        text += 12;
-        text += strspn(text, " \t");
-        m_file_size = atol(text);
+        m_file_size = atol(value);
         LOG_INFO("Got file size: %ld", m_file_size);
+        break;
     }
-    else if (strncasecmp(text, "X-Model-Type:", 13) == 0)
+    case HEADER_MODEL_TYPE:
     {
-        text += 13;
-        text += strspn(text, " \t");
-        model_name = text;
-        LOG_INFO("Got model name: %ld", model_name);
+        model_name = value;
+        LOG_INFO("Got model name: %s", model_name);
+        break;
     }
-    else if (strncasecmp(text, "X-IOU-Threshold:", 16) == 0)
+    case HEADER_IOU_THRESHOLD:
     {
-        text += 16;
-        text += strspn(text, " \t");
-        iou_threshold = str2f.robust_stof(text);
+        iou_threshold = str2f.robust_stof(value);
         LOG_INFO("Got iou threshold: %lf", iou_threshold);
+        break;
     }
-    else if (strncasecmp(text, "X-Confidence-Threshold:", 23) == 0)
+    case HEADER_CONF_THRESHOLD:
     {
-        text += 23;
-        text += strspn(text, " \t");
-        conf_threshold = str2f.robust_stof(text);
+        conf_threshold = str2f.robust_stof(value);
         LOG_INFO("Got confidence threshold: %lf", conf_threshold);
+        break;
     }
-    else if (strncasecmp(text, "X-Image-Size:", 13) == 0)
+    case HEADER_IMAGE_SIZE:
     {
-        text += 13;
-        text += strspn(text, " \t");
         // 格式为：640（不是640x640这样格式）
-        imageHW = std::string(text);
+        imageHW = std::string(value);
         LOG_INFO("Got image width and height: %s", imageHW.c_str());
-    } // 在 parse_headers 方法中添加
-    else if (strncasecmp(text, "Accept-Encoding:", 16) == 0)
+        break;
+    }
+    case HEADER_ACCEPT_ENCODING:
     {
-        text += 16;
-        text += strspn(text, " \t");
-        m_accept_encoding = text;
+        m_accept_encoding = value;
+        m_encoding = ContentCompressor::negotiate(m_accept_encoding);
         LOG_INFO("Accept-Encoding: %s", m_accept_encoding.c_str());
+        break;
     }
-    else if (strncasecmp(text, "Cookie:", 7) == 0)
+    case HEADER_COOKIE:
     {
-        // text 形如 "Cookie: a=1; session_id=abcd...; b=2"
-        const char *p = text + 7;
-        p += strspn(p, " \t");
-        const char *sid = strcasestr(p, "session_id=");
+        // value 形如 "a=1; session_id=abcd...; b=2"
+        const char *sid = strcasestr(value, "session_id=");
         if (sid)
         {
             sid += 11; // 跳过 "session_id="
@@ -729,10 +1003,12 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
             m_session_id = std::string(m_session_id_buf);
             sessions_st.insert(m_session_id);
         }
+        break;
     }
-    else
-    {
+    case HEADER_UNKNOWN:
+    default:
         LOG_INFO("oop!unknow header: %s", text);
+        break;
     }
     // 当前解析了头部信息，下一步需要对内容进行解析，因此这里返回的是不完整的code表示
     return NO_REQUEST;
@@ -743,14 +1019,70 @@ http_conn::HTTP_CODE http_conn::parse_content(char *text)
 {
     if (m_read_idx >= (m_content_length + m_checked_idx))
     {
-        text[m_content_length] = '\0';
-        // POST请求中最后为输入的用户名和密码
+        // POST请求中最后为输入的用户名和密码，finish_request在包体之后写'\0'
         m_string = text;
         return GET_REQUEST;
     }
     return NO_REQUEST;
 }
 
+const char *http_conn::upload_filename() const
+{
+    // HTML表单只能提交GET和POST，表单上传用X-HTTP-Method-Override: PUT
+    bool is_put = m_method == PUT || (m_method_override && strcasecmp(m_method_override, "PUT") == 0);
+    if (!is_put || !m_url)
+        return NULL;
+    const char *p = strrchr(m_url, '/');
+    // 8为普通上传，10、11、12为图像分类、目标检测、语义分割的上传
+    if (*(p + 1) == '8')
+        return m_url + 2;
+    if (*(p + 1) == '1' && (*(p + 2) == '0' || *(p + 2) == '1' || *(p + 2) == '2'))
+        return m_url + 3;
+    return NULL;
+}
+
+http_conn::HTTP_CODE http_conn::begin_content()
+{
+    if (m_content_length < 0)
+        return BAD_REQUEST;
+    const char *filename = upload_filename();
+    if (filename)
+    {
+        if (m_content_length > (long)MAX_UPLOAD_SIZE)
+            return BAD_REQUEST;
+        // 分块信息头在这之前已经解析，决定写进分块临时目录还是uploads目录
+        UploadFile up_file(doc_root, m_close_log);
+        if (!up_file.open_sink(m_upload_sink, filename, chunk_header, total_header))
+            return INTERNAL_ERROR;
+        m_body_received = 0;
+    }
+    // 其他请求（登录、注册的表单）的包体要能完整放进读缓冲区
+    else if (m_checked_idx + m_content_length + 1 > READ_BUFFER_SIZE)
+        return BAD_REQUEST;
+
+    if (m_content_length == 0)
+        return GET_REQUEST;
+    m_check_state = CHECK_STATE_CONTENT;
+    return NO_REQUEST;
+}
+
+http_conn::HTTP_CODE http_conn::stream_content()
+{
+    long avail = m_read_idx - m_checked_idx;
+    long n = std::min(avail, m_content_length - m_body_received);
+    if (n > 0 && !m_upload_sink.write(m_read_buf + m_checked_idx, n))
+    {
+        LOG_ERROR("write upload body failed: %s", strerror(errno));
+        return INTERNAL_ERROR;
+    }
+    m_body_received += n;
+    // 请求头留在原处（m_url等指向这里），包体之后的数据前移，腾出的空间继续接收包体
+    memmove(m_read_buf + m_checked_idx, m_read_buf + m_checked_idx + n, avail - n);
+    m_read_idx -= n;
+    m_read_buf[m_read_idx] = '\0';
+    return m_body_received == m_content_length ? GET_REQUEST : NO_REQUEST;
+}
+
 /*
 判断条件
     主状态机转移到CHECK_STATE_CONTENT，该条件涉及解析消息体
@@ -761,9 +1093,16 @@ http_conn::HTTP_CODE http_conn::parse_content(char *text)
     从状态机读取数据
     调用get_line函数，通过m_start_line将从状态机读取数据间接赋给text
     主状态机解析text
+
+解析的位置和状态都保存在连接中，数据分几次到达时从上次停下的位置继续，
+请求头只解析一次；read_once在读缓冲区满时也会调用，把上传包体写进文件
 */
-http_conn::HTTP_CODE http_conn::process_read()
+http_conn::HTTP_CODE http_conn::parse_request()
 {
+    // 上一次调用已经得到完整的请求
+    if (m_check_state == CHECK_STATE_DONE)
+        return GET_REQUEST;
+
     LINE_STATUS line_status = LINE_OK;
     // 默认是解析当前内容还不完整
     HTTP_CODE ret = NO_REQUEST;
@@ -775,15 +1114,13 @@ http_conn::HTTP_CODE http_conn::process_read()
     {
         // 获得读缓冲区的位置
         text = get_line();
-        // printf("%s %d text = %s\n", __FILE__, __LINE__, text);
         // 更新读取的位置
         m_start_line = m_checked_idx;
-        // 输出读取的内容
-        LOG_INFO("%s", text);
         switch (m_check_state) // 默认初始化解析“行”
         {
         case CHECK_STATE_REQUESTLINE:
         {
+            LOG_INFO("%s", text);
             // 对读取的内容进行“行”解析
             ret = parse_request_line(text);
             if (ret == BAD_REQUEST)
@@ -792,26 +1129,24 @@ http_conn::HTTP_CODE http_conn::process_read()
         }
         case CHECK_STATE_HEADER:
         {
+            LOG_INFO("%s", text);
             // 解析头部信息
             ret = parse_headers(text);
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
-            else if (ret == GET_REQUEST)
-            {
-                // 解析完请求之后就是对浏览器（客户端）的响应
-                return do_request();
-            }
+            if (ret == GET_REQUEST)
+                finish_request(m_checked_idx);
+            if (ret != NO_REQUEST)
+                return ret;
             break;
         }
         case CHECK_STATE_CONTENT:
         {
-            // 解析内容
-            ret = parse_content(text);
+            // 上传的包体写进文件，其他请求的包体等待全部到达读缓冲区
+            ret = m_upload_sink.is_open() ? stream_content() : parse_content(text);
+            // 上传包体之后的数据已经前移到m_checked_idx
             if (ret == GET_REQUEST)
-            {
-                // 解析完请求之后就是对浏览器（客户端）的响应
-                return do_request();
-            }
+                finish_request(m_checked_idx + (m_upload_sink.is_open() ? 0 : m_content_length));
+            if (ret != NO_REQUEST)
+                return ret;
 
             line_status = LINE_OPEN;
             break;
@@ -824,6 +1159,18 @@ http_conn::HTTP_CODE http_conn::process_read()
     return NO_REQUEST;
 }
 
+http_conn::HTTP_CODE http_conn::process_read()
+{
+    // read_once已经发现请求出错，不再重复解析
+    if (m_read_error != NO_REQUEST)
+        return m_read_error;
+    HTTP_CODE ret = parse_request();
+    // 解析完请求之后就是对浏览器（客户端）的响应
+    if (ret == GET_REQUEST)
+        return do_request();
+    return ret;
+}
+
 bool http_conn::process_image_classification(const char *image_path)
 {
     char model_file[160];
@@ -834,7 +1181,8 @@ bool http_conn::process_image_classification(const char *image_path)
     LOG_INFO("model path = %s\n", model_file);
     LOG_INFO("classify image path = %s\n", image_path);
     // 实例化对象
-    Classification cls(std::string(image_path), std::string(model_file), 224, 224, 1, 0);
+    m_cls.reset(new Classification(std::string(image_path), std::string(model_file), 224, 224, 1, 0));
+    Classification &cls = *m_cls;
     try
     {
         // 设置相关属性
@@ -848,8 +1196,6 @@ bool http_conn::process_image_classification(const char *image_path)
         // 执行推理
         cls.predictImage();
 
-        g_cls = cls;
-
         printf("pred = %s conf = %lf\n", cls.getPredResult().c_str(), cls.getPredProb());
 
         LOG_INFO("Image classified: %s (model: %s)", image_path, model_name);
@@ -885,9 +1231,10 @@ bool http_conn::process_image_objectDetection(const char *image_path)
     LOG_INFO("object image h = %ld\n", imgH);
     LOG_INFO("object image w = %ld\n", imgW);
     // 实例化对象
-    ObjectDetection obj(std::string(image_path), std::string(model_file),
-                        imgH, imgW, iou_threshold,
-                        conf_threshold, 1, 0);
+    m_obj.reset(new ObjectDetection(std::string(image_path), std::string(model_file),
+                                    imgH, imgW, iou_threshold,
+                                    conf_threshold, 1, 0));
+    ObjectDetection &obj = *m_obj;
     try
     {
         // 设置相关属性
@@ -903,8 +1250,6 @@ bool http_conn::process_image_objectDetection(const char *image_path)
 
         // obj.encodeImage(obj.getImage());
 
-        g_obj = obj;
-
         LOG_INFO("Image detect: %s (model: %s)", image_path, model_name);
     }
     catch (const std::exception &e)
@@ -934,8 +1279,9 @@ bool http_conn::process_image_segmentation(const char *image_path)
     LOG_INFO("segmentation image h = %ld\n", imgH);
     LOG_INFO("segmentation image w = %ld\n", imgW);
     // 实例化对象
-    Segmentation seg(std::string(image_path), std::string(model_file),
-                     imgH, imgW, 1, 0);
+    m_seg.reset(new Segmentation(std::string(image_path), std::string(model_file),
+                                 imgH, imgW, 1, 0));
+    Segmentation &seg = *m_seg;
     try
     {
         // 设置相关属性
@@ -950,8 +1296,6 @@ bool http_conn::process_image_segmentation(const char *image_path)
         // 执行推理
         seg.predictImage();
 
-        g_seg = seg;
-
         LOG_INFO("Image detect: %s (model: %s)", image_path, model_name);
     }
     catch (const std::exception &e)
@@ -1028,41 +1372,19 @@ http_conn::HTTP_CODE http_conn::do_request()
     }
 
     // 在do_request()的最前面添加上传文件：
-    if (actual_method == PUT && (*(p + 1) == '8' || (*(p + 1) == '1' && *(p + 2) == '0') || (*(p + 1) == '1' && *(p + 2) == '1') || (*(p + 1) == '1' && *(p + 2) == '2')))
+    const char *filename = upload_filename();
+    if (filename)
     {
-        char *filename = NULL;
-        if (*(p + 1) == '8')
-        {
-            filename = m_url + 2;
-            printf("general upload file\n");
-        }
-        else if (*(p + 1) == '1' && *(p + 2) == '0')
-        {
-            filename = m_url + 3;
-            printf("classify upload file\n");
-        }
-        else if (*(p + 1) == '1' && *(p + 2) == '1')
-        {
-            filename = m_url + 3;
-            printf("object detect file\n");
-        }
-        else if ((*(p + 1) == '1' && *(p + 2) == '2'))
-        {
-            filename = m_url + 3;
-            printf("segmentation file\n");
-        }
-
         // 获取分块信息头：块的大小以及总的块数量
         int chunk_num = chunk_header, total_chunks = total_header;
 
-        // 保存分块或完整文件
-        bool save_result = false;
+        // 包体在接收时已经写进了分块或完整文件，这里只需要确认写完
+        bool save_result = m_upload_sink.finish();
         bool is_merge_file = false;
         if (total_chunks > 1)
         {
-            // 分块上传文件
-            save_result = up_file.save_uploaded_chunk(filename, m_string, m_content_length,
-                                                      chunk_num, total_chunks);
+            if (save_result)
+                LOG_INFO("Saved chunk %d/%d of %s (%ld bytes)", chunk_num + 1, total_chunks, filename, m_content_length);
 
             // 如果是最后一个分块，合并文件
             if (save_result && chunk_num == total_chunks - 1)
@@ -1071,11 +1393,6 @@ http_conn::HTTP_CODE http_conn::do_request()
                 is_merge_file = true;
             }
         }
-        else
-        {
-            // 单块直接保存
-            save_result = up_file.save_uploaded_file(filename, m_string, m_content_length);
-        }
 
         // 如果是图像分类,并且等图像完整的上传完整之后，那么还需要进行分类检测
         if (this->model_name != NULL && save_result)
@@ -1103,9 +1420,9 @@ http_conn::HTTP_CODE http_conn::do_request()
                     snprintf(save_path, sizeof(save_path), "%s/%s/%s", doc_root, "outputs", filename);
 
                     // 获得结果图像（坐标框绘制之后的结果）
-                    cv::Mat Image = g_obj.getImageObj();
+                    cv::Mat Image = m_obj->getImageObj();
                     // 获得原始图像大小
-                    pair<size_t, size_t> org_img_hw = g_obj.getOrgImgHW();
+                    pair<size_t, size_t> org_img_hw = m_obj->getOrgImgHW();
                     // 将图像从(640, 640)还原回原始图像大小
                     cv::resize(Image, Image, cv::Size(org_img_hw.second, org_img_hw.first));
 
@@ -1132,9 +1449,9 @@ http_conn::HTTP_CODE http_conn::do_request()
                     snprintf(save_path, sizeof(save_path), "%s/%s/%s", doc_root, "outputs", filename);
 
                     // 获得结果图像（坐标框绘制之后的结果）
-                    cv::Mat Image = g_seg.getImageObj();
+                    cv::Mat Image = m_seg->getImageObj();
                     // 获得原始图像大小
-                    pair<size_t, size_t> org_img_hw = g_seg.getOrgImgHW();
+                    pair<size_t, size_t> org_img_hw = m_seg->getOrgImgHW();
                     // 将图像从(640, 640)还原回原始图像大小
                     cv::resize(Image, Image, cv::Size(org_img_hw.second, org_img_hw.first));
 
@@ -1469,7 +1786,39 @@ http_conn::HTTP_CODE http_conn::do_request()
         return BAD_REQUEST;
     }
 
+    // 客户端接受br/gzip并且有预先生成的旁路文件时，改为发送旁路文件
+    if (is_compress_ && CompressionPolicy::instance().should_compress(file_extension(), m_file_stat.st_size))
+    {
+        ContentCompressor::EncodingType encoding = preferred_encoding();
+        std::string sidecar;
+        struct stat sidecar_st;
+        if (CompressedCache::instance().find_sidecar(m_real_file, m_file_stat, encoding, sidecar, sidecar_st) &&
+            sidecar.size() < FILENAME_LEN)
+        {
+            strcpy(m_real_file, sidecar.c_str());
+            m_file_stat = sidecar_st;
+            m_sidecar_encoding = encoding;
+        }
+    }
+
+    // 小文件直接使用内存中的缓存，stat结果用于判断缓存是否过期
+    m_cached_file = FileCache::instance().get(m_real_file, m_file_stat);
+    if (m_cached_file)
+    {
+        m_file_address = const_cast<char *>(m_cached_file->data.data());
+        return FILE_REQUEST;
+    }
+
     int fd = open(m_real_file, O_RDONLY);
+    if (fd < 0)
+        return NO_RESOURCE;
+    // 文件内容由内核从页缓存直接发到socket，省去mmap/munmap以及缺页的开销
+    if (use_sendfile())
+    {
+        m_file_fd = fd;
+        m_file_offset = 0;
+        return FILE_REQUEST;
+    }
     /*
         打开文件并内存映射
             0：让系统自动选择映射地址
@@ -1486,133 +1835,355 @@ http_conn::HTTP_CODE http_conn::do_request()
 }
 void http_conn::unmap()
 {
-    if (m_file_address)
+    if (m_cached_file)
+    {
+        // 缓存中的数据不是映射区，只需要释放引用
+        m_cached_file.reset();
+        m_file_address = 0;
+    }
+    else if (m_file_address)
     {
         // 释放内存映射区
         munmap(m_file_address, m_file_stat.st_size);
         m_file_address = 0;
     }
+    if (m_file_fd >= 0)
+    {
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+    m_compressed_body.reset();
+    m_stream_compressor.reset();
+    m_stream_buf.clear();
+    m_stream_offset = 0;
+}
+
+std::string http_conn::file_extension() const
+{
+    const char *dot = strrchr(m_real_file, '.');
+    return dot ? std::string(dot + 1) : std::string();
+}
+
+ContentCompressor::EncodingType http_conn::preferred_encoding() const
+{
+    return m_encoding;
+}
+
+bool http_conn::fill_stream_chunk()
+{
+    // 预留chunk长度行的位置，压缩结果直接追加在后面，不需要再拷贝一次
+    const size_t prefix = 16;
+    m_stream_buf.resize(prefix);
+    // 一个窗口压缩之后可能没有输出，继续压缩下一个窗口，避免发出表示结束的空chunk
+    do
+    {
+        size_t length = m_file_stat.st_size - m_stream_offset;
+        if (length > STREAM_WINDOW)
+            length = STREAM_WINDOW;
+        m_stream_done = m_stream_offset + (off_t)length == m_file_stat.st_size;
+        size_t before = m_stream_buf.size();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!m_stream_compressor->compress(m_file_address + m_stream_offset, length, m_stream_done, m_stream_buf))
+            return false;
+        uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+        MonitorSystem::instance().record_compression(file_extension(), length, m_stream_buf.size() - before, time_us);
+        m_stream_offset += length;
+    } while (m_stream_buf.size() == prefix && !m_stream_done);
+
+    size_t data_len = m_stream_buf.size() - prefix;
+    size_t start = prefix;
+    if (data_len > 0)
+    {
+        char line[prefix];
+        int n = snprintf(line, sizeof(line), "%zx\r\n", data_len);
+        start = prefix - n;
+        memcpy(&m_stream_buf[start], line, n);
+        m_stream_buf.push_back('\r');
+        m_stream_buf.push_back('\n');
+    }
+    if (m_stream_done)
+    {
+        // 最后一个chunk后面紧跟结束标记，压缩器状态可以立即释放
+        static const char last_chunk[] = "0\r\n\r\n";
+        m_stream_buf.insert(m_stream_buf.end(), last_chunk, last_chunk + sizeof(last_chunk) - 1);
+        m_stream_compressor.reset();
+    }
+
+    m_body_address = &m_stream_buf[start];
+    m_iv[1].iov_base = (void *)m_body_address;
+    m_iv[1].iov_len = m_stream_buf.size() - start;
+    m_iv_count = 2;
+    return true;
+}
+
+// SSL连接需要在用户态加密，需要压缩的文件需要完整的内容，这两种情况仍然走mmap
+bool http_conn::use_sendfile()
+{
+    if (m_file_stat.st_size == 0)
+        return false;
+    // TLS连接只有在内核接管了记录加密（kTLS）时才能sendfile，否则文件内容要经过用户态加密
+    if (use_ssl_ && !(is_connect_success && ssl_wrapper_ && ssl_wrapper_->ktls_send()))
+        return false;
+    // 旁路文件本身已经是压缩数据，可以直接sendfile
+    if (is_compress_ && CompressionPolicy::instance().should_compress(file_extension(), m_file_stat.st_size) &&
+        preferred_encoding() != ContentCompressor::NONE)
+        return false;
+    return true;
+}
+
+// 先发送响应头（MSG_MORE让内核等后面的文件内容一起组包），再用sendfile发送文件；
+// bytes_have_send和m_file_offset记录发送进度，EAGAIN之后重新注册EPOLLOUT从断点继续。
+// kTLS连接上响应头走SSL_write，文件走SSL_sendfile，两者都由内核加密
+bool http_conn::write_sendfile()
+{
+    while (bytes_to_send > 0)
+    {
+        ssize_t n;
+        if (bytes_have_send < m_write_idx)
+        {
+            if (use_ssl_)
+            {
+                struct iovec header;
+                header.iov_base = m_write_buf + bytes_have_send;
+                header.iov_len = m_write_idx - bytes_have_send;
+                n = ssl_wrapper_->writev(&header, 1);
+            }
+            else
+                n = send(m_sockfd, m_write_buf + bytes_have_send, m_write_idx - bytes_have_send,
+                         MSG_MORE | MSG_NOSIGNAL);
+        }
+        else if (use_ssl_)
+            n = ssl_wrapper_->sendfile(m_file_fd, m_file_offset, bytes_to_send);
+        else
+            n = sendfile(m_sockfd, m_file_fd, &m_file_offset, bytes_to_send);
+
+        if (n < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                return true;
+            }
+            unmap();
+            return false;
+        }
+        // 文件在发送过程中被截断
+        if (n == 0)
+        {
+            unmap();
+            return false;
+        }
+        monitor_adapter_.on_data_written(n);
+        bytes_have_send += n;
+        bytes_to_send -= n;
+    }
+
+    if (use_ssl_)
+        MonitorSystem::instance().record_ktls_sendfile(m_file_stat.st_size);
+    return finish_response();
+}
+// 只查看读缓冲区开头的请求行，不修改解析状态；推理接口都是PUT（或带方法覆盖的POST）上传
+bool http_conn::is_inference_request() const
+{
+    const char *url = NULL;
+    const char *end = NULL;
+    /*请求行已经解析过（上传包体超过读缓冲区时read_once会先解析，请求行中的空格已经被改成'\0'），
+      按解析结果判断；还没有解析时直接看读缓冲区开头的原始数据*/
+    if (m_check_state != CHECK_STATE_REQUESTLINE)
+    {
+        if ((m_method != PUT && m_method != POST) || !m_url)
+            return false;
+        url = m_url;
+        end = m_url + strlen(m_url);
+    }
+    else
+    {
+        const char *text = m_read_buf;
+        end = m_read_buf + m_read_idx;
+        if (end - text > 4 && strncmp(text, "PUT ", 4) == 0)
+            url = text + 4;
+        else if (end - text > 5 && strncmp(text, "POST ", 5) == 0)
+            url = text + 5;
+    }
+    if (!url || end - url < 3)
+        return false;
+    return url[0] == '/' && url[1] == '1' && (url[2] == '0' || url[2] == '1' || url[2] == '2');
+}
+
+void http_conn::reject_busy(int retry_after)
+{
+    // 请求体可能还没有读完，响应之后直接关闭连接，不再继续解析剩余数据
+    m_linger = false;
+    m_write_idx = 0;
+    add_status_line(503, error_503_title);
+    add_response("Retry-After:%d\r\n", retry_after);
+    add_headers(strlen(error_503_form));
+    add_blank_line();
+    add_content(error_503_form);
+
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    m_iv_count = 1;
+    bytes_to_send = m_write_idx;
+    LOG_WARN("inference lane is full, reject fd %d", m_sockfd);
+    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+}
+
+bool http_conn::finish_response()
+{
+    unmap();
+    // 后面的请求已经开始解析时，刚刚发完的是它前面留在写缓冲区的长连接响应，只重置发送状态
+    if (m_check_state != CHECK_STATE_DONE)
+    {
+        m_write_idx = 0;
+        bytes_to_send = 0;
+        bytes_have_send = 0;
+        release_write_buf();
+    }
+    // 即将关闭的连接不再重新注册事件，由事件循环删除定时器并关闭
+    else if (!m_linger)
+        return false;
+    else
+        next_request(false);
+    // 先重置连接状态再重新注册读事件；读缓冲区中已经有下一个请求时由调用者接着处理
+    if (!has_pending_request())
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+    return true;
+}
+
+bool http_conn::queue_response()
+{
+    // 只有长连接上读缓冲区中紧接着还有数据时才留下
+    if (!m_linger || m_check_state != CHECK_STATE_DONE || m_request_end >= m_read_idx)
+        return false;
+    // sendfile和流式压缩的响应只能作为最后一个发送
+    if (m_file_fd >= 0 || stream_active())
+        return false;
+    // 包体（文件缓存、mmap或者压缩数据）复制到响应头后面，写缓冲区放不下时直接发送
+    size_t body_len = m_iv_count == 2 ? m_iv[1].iov_len : 0;
+    if (m_write_idx + body_len + 1 > (size_t)WRITE_BUFFER_SIZE || !grow_write_buf(m_write_idx + body_len + 1))
+        return false;
+    if (body_len > 0)
+    {
+        memcpy(m_write_buf + m_write_idx, m_iv[1].iov_base, body_len);
+        m_write_idx += body_len;
+    }
+    next_request(true);
+    return true;
 }
+
 bool http_conn::write()
 {
     int temp = 0;
-    int ssl_write_total = 0;
-    bool is_error = false;
 
     if (bytes_to_send == 0)
     {
+        // 先重置连接状态再重新注册读事件，避免事件循环把下一个请求交给其他线程时状态还未重置
+        init();
         // 修改当前fd在epoll上的状态（读）
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        init();
         return true;
     }
 
-    // 其实这里发送信息也可以考虑使用“零拷贝技术”sendfile来实现
+    // 明文静态文件使用sendfile零拷贝发送
+    if (m_file_fd >= 0)
+        return write_sendfile();
+
     while (1)
     {
+        // 使用 writev() 替代多次 write()，减少系统调用次数。
+        // m_iv 本身不存储数据，它只是记录了多个数据块的位置和长度
+        // SSL连接由SSLWrapper把m_iv合并成TLS记录加密发送，返回值和错误码的含义与writev相同
         if (use_ssl_ && is_connect_success)
-        {
-            try
-            {
-                ssl_write_total = ssl_wrapper_->write(m_iv, m_iv_count);
-            }
-            catch (const std::exception &e)
-            {
-                is_error = true;
-                std::cerr << __FILE__ << " " << __LINE__ << " " << e.what() << '\n';
-                LOG_ERROR("%s %d %s", __FILE__, __LINE__, e.what());
-            }
-            bytes_to_send -= ssl_write_total;
-
-            if (ssl_write_total > 0)
-            {
-                monitor_adapter_.on_data_written(temp);
-            }
-        }
+            temp = ssl_wrapper_->writev(m_iv, m_iv_count);
         else
-        {
-            // 使用 writev() 替代多次 write()，减少系统调用次数。
-            // m_iv 本身不存储数据，它只是记录了多个数据块的位置和长度
-            // 调用系统IO写操作（系统将 m_iv 描述的分散数据（iovec 结构数组）拷贝到内核的 套接字发送缓冲区）
             temp = writev(m_sockfd, m_iv, m_iv_count);
-            if (temp < 0)
+        if (temp < 0)
+        {
+            // 数据发送完毕之后修改当前socket fd为监听写事件
+            if (errno == EAGAIN) // 该信号表示try  again，因为可能数据没有写完或者缓冲区满，因此需要epoll继续进行监听
             {
-                // 数据发送完毕之后修改当前socket fd为监听写事件
-                if (errno == EAGAIN) // 该信号表示try  again，因为可能数据没有写完或者缓冲区满，因此需要epoll继续进行监听
-                {
-                    // 如果内核缓冲区已满，可能阻塞（默认行为）或返回部分写入（非阻塞模式）
-                    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
-                    return true;
-                }
-                unmap(); // 文件发送完毕之后，关闭文件共享映射区
-                return false;
+                // 如果内核缓冲区已满，可能阻塞（默认行为）或返回部分写入（非阻塞模式）
+                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                return true;
             }
+            unmap(); // 文件发送完毕之后，关闭文件共享映射区
+            return false;
+        }
 
-            if (temp > 0)
-            {
-                monitor_adapter_.on_data_written(temp);
-            }
+        if (temp > 0)
+        {
+            monitor_adapter_.on_data_written(temp);
+        }
 
-            // 当前已发送的字节数
-            bytes_have_send += temp;
-            // 剩余多少字节数未发
-            bytes_to_send -= temp;
+        // 当前已发送的字节数
+        bytes_have_send += temp;
+        // 剩余多少字节数未发
+        bytes_to_send -= temp;
 
-            // 如果当前已发送的字节数大于了之前指定的m_write_idx位置，也就是头部信息发送完成，现在就是包体内容需要发送了
-            if (bytes_have_send >= m_iv[0].iov_len)
-            {
-                m_iv[0].iov_len = 0;
-                // 从共享文件映射区的地址的位置开始拷贝
-                m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-                m_iv[1].iov_len = bytes_to_send;
-            }
-            else
-            {
-                // 否则移动指针的位置
-                m_iv[0].iov_base = m_write_buf + bytes_have_send;
-                // 剩余要发送的字节数
-                m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-            }
+        // 如果当前已发送的字节数大于了之前指定的m_write_idx位置，也就是头部信息发送完成，现在就是包体内容需要发送了
+        // （必须和m_write_idx比较：头部只发出一部分时m_iv[0].iov_len已经变成了剩余长度）
+        if (bytes_have_send >= m_write_idx)
+        {
+            m_iv[0].iov_len = 0;
+            // 从共享文件映射区的地址的位置开始拷贝
+            m_iv[1].iov_base = (char *)m_body_address + (bytes_have_send - m_write_idx);
+            m_iv[1].iov_len = bytes_to_send;
         }
-        // 发送完成数据
-        if (bytes_to_send <= 0 || is_error)
+        else
         {
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+            // 否则移动指针的位置
+            m_iv[0].iov_base = m_write_buf + bytes_have_send;
+            // 剩余要发送的字节数
+            m_iv[0].iov_len = m_write_idx - bytes_have_send;
+        }
 
-            // 是否优雅的关闭
-            if (m_linger)
-            {
-                init();
-                return true;
-            }
-            else
+        // 流式压缩：当前chunk已经发送完，压缩下一个窗口接着发送
+        if (bytes_to_send <= 0 && stream_active())
+        {
+            if (!fill_stream_chunk())
             {
+                unmap();
                 return false;
             }
+            bytes_have_send = m_write_idx;
+            bytes_to_send = m_iv[1].iov_len;
+            continue;
         }
+        // 发送完成数据
+        if (bytes_to_send <= 0)
+            return finish_response();
     }
 }
 bool http_conn::add_response(const char *format, ...)
 {
     // 如果写入位置大于了写缓冲区大小就直接返回false
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
+    if (m_write_idx >= WRITE_BUFFER_SIZE || !grow_write_buf(BufferPool::MIN_BUFFER_SIZE))
     {
         return false;
     }
 
-    va_list arg_list;
+    va_list arg_list, retry_list;
     va_start(arg_list, format);
+    va_copy(retry_list, arg_list);
     // 给写文件缓冲区添加响应信息
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx,
+    int len = vsnprintf(m_write_buf + m_write_idx, m_write_size - 1 - m_write_idx,
                         format, arg_list);
-    // 如果当前内容长度大于了写入缓冲区的大小，就直接返回false
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
+    // 当前的写缓冲区装不下时换一个更大的再写一次，超过WRITE_BUFFER_SIZE就直接返回false
+    if (len >= (m_write_size - 1 - m_write_idx))
     {
-        va_end(arg_list);
-        return false;
+        if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx) || !grow_write_buf(m_write_idx + len + 2))
+        {
+            va_end(retry_list);
+            va_end(arg_list);
+            return false;
+        }
+        vsnprintf(m_write_buf + m_write_idx, m_write_size - 1 - m_write_idx, format, retry_list);
     }
     m_write_idx += len;
+    va_end(retry_list);
     va_end(arg_list);
 
     LOG_INFO("request:%s", m_write_buf);
@@ -1676,6 +2247,24 @@ bool http_conn::process_write(HTTP_CODE ret)
             return false;
         break;
     }
+    case AMBIGUOUS_REQUEST: // 长度有歧义的请求
+    {
+        printf("AMBIGUOUS_REQUEST---->\n");
+        add_status_line(400, error_400_title);
+        add_headers(strlen(error_400_form));
+        if (!add_content(error_400_form))
+            return false;
+        break;
+    }
+    case NOT_IMPLEMENTED: // 不支持的Transfer-Encoding
+    {
+        printf("NOT_IMPLEMENTED---->\n");
+        add_status_line(501, error_501_title);
+        add_headers(strlen(error_501_form));
+        if (!add_content(error_501_form))
+            return false;
+        break;
+    }
     case FORBIDDEN_REQUEST: // 禁止访问
     {
         printf("FORBIDDEN_REQUEST---->\n");
@@ -1704,59 +2293,60 @@ bool http_conn::process_write(HTTP_CODE ret)
         }
 
         // 数据压缩相关
-        // 获取文件扩展名
-        std::string file_path(m_real_file);
-        size_t dot_pos = file_path.find_last_of('.');
-        std::string file_extension = (dot_pos != std::string::npos) ? file_path.substr(dot_pos + 1) : "";
-
-        // 检查并执行压缩
-        if (is_compress_ && compressor_.should_compress(file_extension, m_accept_encoding))
+        if (m_sidecar_encoding != ContentCompressor::NONE)
         {
-            // 优先尝试 Brotli
-            if (m_accept_encoding.find("br") != std::string::npos)
-            {
-                if (compressor_.compress(m_file_address, m_file_stat.st_size,
-                                         ContentCompressor::BROTLI))
-                {
-                    add_response(compressor_.content_encoding_header().c_str());
-                }
-            }
-            else if (m_accept_encoding.find("gzip") != std::string::npos)
-            {
-                if (compressor_.compress(m_file_address, m_file_stat.st_size,
-                                         ContentCompressor::GZIP))
-                {
-                    add_response(compressor_.content_encoding_header().c_str());
-                }
-            }
-            else if (m_accept_encoding.find("deflate") != std::string::npos)
+            // 发送的是预先生成的旁路文件，文件内容本身就是压缩数据
+            add_response("Content-Encoding: %s\r\n", ContentCompressor::encoding_name(m_sidecar_encoding));
+            add_response("Vary: Accept-Encoding\r\n");
+        }
+        // 检查并执行压缩（sendfile路径下文件没有映射到内存，不压缩）
+        else if (is_compress_ && m_file_address &&
+                 CompressionPolicy::instance().should_compress(file_extension(), m_file_stat.st_size))
+        {
+            // 压缩结果在所有连接之间共享，同一文件同一编码只压缩一次；压缩级别由当前负载决定
+            ContentCompressor::EncodingType encoding = preferred_encoding();
+            int quality = CompressionPolicy::instance().quality(encoding);
+            // 大文件不在内存中保存完整的压缩结果，改为边压缩边分块发送
+            if (encoding != ContentCompressor::NONE && m_file_stat.st_size >= STREAM_COMPRESS_MIN)
             {
-                if (compressor_.compress(m_file_address, m_file_stat.st_size,
-                                         ContentCompressor::DEFLATE))
-                {
-                    add_response(compressor_.content_encoding_header().c_str());
-                }
+                m_stream_compressor.reset(new StreamCompressor());
+                if (!m_stream_compressor->begin(encoding, quality))
+                    m_stream_compressor.reset();
             }
+            else if (encoding != ContentCompressor::NONE)
+                m_compressed_body = CompressedCache::instance().get(m_real_file, m_file_stat, encoding,
+                                                                    m_file_address, quality);
+            if (m_compressed_body || stream_active())
+                add_response("Content-Encoding: %s\r\n", ContentCompressor::encoding_name(encoding));
+            // 同一个URL会按Accept-Encoding返回不同的内容
+            add_response("Vary: Accept-Encoding\r\n");
         }
 
         // 文件大小不为0（确实有信息需要发送）
         if (m_file_stat.st_size != 0)
         {
-            size_t content_length = compressor_.compressed_size() > 0 && is_compress_ ? compressor_.compressed_size() : m_file_stat.st_size;
-            add_headers(content_length);
+            size_t content_length = m_compressed_body ? m_compressed_body->size() : m_file_stat.st_size;
+            if (stream_active())
+            {
+                // 压缩后的长度事先未知，使用分块传输
+                add_response("Transfer-Encoding: chunked\r\n");
+                add_linger();
+            }
+            else
+                add_headers(content_length);
             // 针对图像分类
             if (is_objectDetect == false && is_segmentation == false)
             {
                 // 填写自定义字段（一定要注意响应的格式： 状态行 → 标准头字段 → CORS字段 → 自定义字段）
                 // 针对分类
-                if (model_name && is_response_result)
+                if (model_name && is_response_result && m_cls)
                 {
                     // 4. 关键改进：将关键数据同时放入头部
                     printf("add classification result to header\n");
                     add_response("X-Model-Used:%s\r\n", model_name);
-                    add_response("X-Top-Class:%s\r\n", g_cls.getPredResult().c_str());
-                    add_response("X-Confidence:%s\r\n", std::to_string(g_cls.getPredProb()).c_str());
-                    add_response("X-Inference-Time:%s\r\n", std::to_string(g_cls.getInferTime()).c_str());
+                    add_response("X-Top-Class:%s\r\n", m_cls->getPredResult().c_str());
+                    add_response("X-Confidence:%s\r\n", std::to_string(m_cls->getPredProb()).c_str());
+                    add_response("X-Inference-Time:%s\r\n", std::to_string(m_cls->getInferTime()).c_str());
 
                     // 5. 可选：添加调试信息
                     add_response("X-Predictions-Count:%s\r\n", "1");
@@ -1764,22 +2354,22 @@ bool http_conn::process_write(HTTP_CODE ret)
                 }
             }
             // 针对目标检测结果返回
-            else if (is_objectDetect)
+            else if (is_objectDetect && m_obj)
             {
                 add_content_type();
                 add_response("X-Model-Used:%s\r\n", model_name);
-                add_response("X-Inference-Time:%s\r\n", std::to_string(g_obj.getInferTime()).c_str());
-                add_response("X-Detect-Count:%s\r\n", std::to_string(g_obj.getDetectCount()).c_str());
+                add_response("X-Inference-Time:%s\r\n", std::to_string(m_obj->getInferTime()).c_str());
+                add_response("X-Detect-Count:%s\r\n", std::to_string(m_obj->getDetectCount()).c_str());
 
                 // 内容
                 is_objectDetect = false;
                 model_name = NULL;
             }
-            else if (is_segmentation)
+            else if (is_segmentation && m_seg)
             {
                 add_content_type();
                 add_response("X-Model-Used:%s\r\n", model_name);
-                add_response("X-Inference-Time:%s\r\n", std::to_string(g_obj.getInferTime()).c_str());
+                add_response("X-Inference-Time:%s\r\n", std::to_string(m_seg->getInferTime()).c_str());
                 is_segmentation = false;
                 model_name = NULL;
             }
@@ -1790,22 +2380,30 @@ bool http_conn::process_write(HTTP_CODE ret)
             m_iv[0].iov_base = m_write_buf;
             m_iv[0].iov_len = m_write_idx;
 
-            // 第二个iovec指针指向mmap返回的文件指针(比如.html文件之类的文件内容)，长度指向文件大小
-            if (compressor_.compressed_size() > 0 && is_compress_)
+            // sendfile路径：这里只准备响应头，文件内容在write_sendfile中发送
+            if (m_file_fd >= 0)
             {
-                // 使用压缩后的数据
-                m_iv[1].iov_base = (void *)compressor_.compressed_data().data();
-                m_iv[1].iov_len = compressor_.compressed_size();
+                m_iv_count = 1;
+                bytes_to_send = m_write_idx + m_file_stat.st_size;
+                return true;
             }
-            else
+
+            // 流式压缩：先压缩第一个窗口，和响应头一起发送
+            if (stream_active())
             {
-                // 使用原始文件数据
-                m_iv[1].iov_base = m_file_address;
-                m_iv[1].iov_len = m_file_stat.st_size;
+                if (!fill_stream_chunk())
+                    return false;
+                bytes_to_send = m_write_idx + m_iv[1].iov_len;
+                return true;
             }
+
+            // 第二个iovec指针指向包体：压缩后的数据，或者mmap/文件缓存中的文件内容
+            m_body_address = m_compressed_body ? m_compressed_body->data() : m_file_address;
+            m_iv[1].iov_base = (void *)m_body_address;
+            m_iv[1].iov_len = content_length;
             m_iv_count = 2;
-            // 发送的全部数据为响应报文头部信息和文件大小
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
+            // 发送的全部数据为响应报文头部信息和包体大小
+            bytes_to_send = m_write_idx + content_length;
             printf("m_file_stat.size: %d\n", m_file_stat.st_size);
 
             return true;
@@ -1831,25 +2429,61 @@ bool http_conn::process_write(HTTP_CODE ret)
     bytes_to_send = m_write_idx;
     return true;
 }
+/*
+流水线（pipelining）：客户端不等响应就在同一个连接上连续发送多个请求，
+读缓冲区中一个请求之后可能紧接着下一个请求。响应必须按请求的顺序发送：
+    请求处理完、响应生成之后，如果读缓冲区中还有数据，queue_response把响应（连同包体）
+    留在写缓冲区，下一个请求移到读缓冲区开头继续解析，最后所有响应用一次writev发出；
+    sendfile和流式压缩的响应、写缓冲区放不下的响应只能作为最后一个，发送完之后
+    finish_response保留读缓冲区中剩下的请求，由调用者接着调用process()
+*/
 void http_conn::process()
 {
-    monitor_adapter_.on_request_start(m_method);
-    // printf("start parse data %s %d\n", __FILE__, __LINE__);
-    HTTP_CODE read_ret = process_read();
-    // 如果解析的请求消息不完整就需要继续解析，修改当前的socket fd依然是监听读事件操作
-    if (read_ret == NO_REQUEST)
+    bool queued = false; // 写缓冲区中有等待和后面的响应一起发送的响应
+    while (true)
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        return;
+        monitor_adapter_.on_request_start(m_method);
+        HTTP_CODE read_ret = process_read();
+        // 如果解析的请求消息不完整就需要继续解析
+        if (read_ret == NO_REQUEST)
+            break;
+        // 请求没有解析完就出错时找不到下一个请求从哪里开始，丢弃剩下的数据，响应之后关闭连接
+        if (m_check_state != CHECK_STATE_DONE)
+        {
+            finish_request(m_read_idx);
+            m_linger = false;
+        }
+        bool write_ret = process_write(read_ret);
+
+        monitor_adapter_.on_request_end(read_ret, is_connect_success);
+        // 生成响应失败则关闭连接，连接已经从epoll上移除，不再注册写事件
+        if (!write_ret)
+        {
+            close_conn();
+            return;
+        }
+        // 响应放不进写缓冲区，注册写事件到epoll上，表示需要继续监听当前写事件
+        if (!queue_response())
+        {
+            modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+            return;
+        }
+        queued = true;
+        // 推理请求交给推理线程池，等前面的响应发出去之后再处理
+        if (is_inference_request())
+            break;
     }
-    // printf("start write data %s %d read ret = %d\\n", __FILE__, __LINE__, read_ret);
-    bool write_ret = process_write(read_ret);
 
-    monitor_adapter_.on_request_end(read_ret, is_connect_success);
-    // 如果读取出现问题，则关闭连接，并且注册写事件到epoll上，表示需要继续监听当前写事件
-    if (!write_ret)
+    // 修改当前的socket fd依然是监听读事件操作
+    if (!queued)
     {
-        close_conn();
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        return;
     }
+    // 后面的请求还不完整，先发送已经生成的响应
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    m_iv_count = 1;
+    bytes_to_send = m_write_idx;
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
 }
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
 #include <dirent.h>    // 用于目录操作
 #include <sys/types.h> // 用于 DIR 等类型定义
@@ -27,6 +28,8 @@
 #include <array>
 #include <set>
 #include <iostream>
+#include <atomic>
+#include <memory>
 
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
@@ -36,11 +39,20 @@
 #include "str2float.h"
 #include "../deepLearning/objectDetect/objectDetection.h"
 #include "upload_file.h"
+#include "http_scan.h"
 #include "../deepLearning/segmentation/segmentation.h"
 #include "../ssl/ssl_context.h"
 #include "../ssl/ssl_wrapper.h"
 #include "../compressor/content_compressor.h"
+#include "../compressor/compressed_cache.h"
+#include "../compressor/stream_compressor.h"
+#include "../compressor/compression_policy.h"
 #include "../monitor/http_conn_monitor_system.h"
+#include "../cache/file_cache.h"
+#include "../buffer/buffer_pool.h"
+#include "../buffer/object_pool.h"
+
+class completion_queue;
 
 struct session_info
 {
@@ -57,11 +69,14 @@ struct session_info
 class http_conn
 {
 public:
-    // 定义文件长度，读和写缓冲区大小
+    // 定义文件长度，读和写缓冲区的最大长度（缓冲区从BufferPool按需借用，装满之后再扩大）
     static const int FILENAME_LEN = 200;
     static const int READ_BUFFER_SIZE = 2048 * 128;
     static const int WRITE_BUFFER_SIZE = 1024 * 32;
     static const size_t MAX_UPLOAD_SIZE = 10 * 1024 * 1024; // 10MB
+    static const off_t STREAM_COMPRESS_MIN = 256 * 1024;    // 超过256KB的文件流式压缩，分块发送
+    static const size_t STREAM_WINDOW = 64 * 1024;          // 流式压缩每次压缩的输入大小
+    static const int UPLOAD_WINDOW = 64 * 1024;             // 上传包体在读缓冲区中最多积攒的大小，满了就写进文件
     // HTTP各种请求
     enum METHOD
     {
@@ -80,7 +95,8 @@ public:
     {
         CHECK_STATE_REQUESTLINE = 0, // 请求行状态
         CHECK_STATE_HEADER,          // 请求头状态
-        CHECK_STATE_CONTENT          // 请求内容的状态
+        CHECK_STATE_CONTENT,         // 请求内容的状态
+        CHECK_STATE_DONE             // 请求已经完整，等待do_request处理
     };
     enum HTTP_CODE
     {
@@ -91,7 +107,9 @@ public:
         FORBIDDEN_REQUEST, // 请求资源禁止访问，没有读取权限
         FILE_REQUEST,      // 请求资源可以正常访问
         INTERNAL_ERROR,    // 服务器内部错误，该结果在主状态机逻辑switch的default下，一般不会触发
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        AMBIGUOUS_REQUEST, // 请求的长度有歧义（重复的Content-Length、名称和冒号之间有空白等），响应400
+        NOT_IMPLEMENTED    // 请求带Transfer-Encoding，服务器不支持分块的请求包体，响应501
     };
     // 从状态机的状态
     enum LINE_STATUS
@@ -102,11 +120,20 @@ public:
     };
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn() : m_cq(NULL), m_read_buf(NULL), m_read_size(0), m_write_buf(NULL), m_write_size(0),
+                  m_file_address(NULL), m_file_fd(-1) {}
+    ~http_conn() { release_buffers(); }
 
 public:
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int,
+    // 从slab中借一个连接对象，连接关闭时用recycle还回去
+    static http_conn *create();
+    static void recycle(http_conn *conn);
+    // 连接交给工作线程（或推理线程）之前加一次引用，任务处理完用release减掉；
+    // 最后一个引用减掉时才关闭socket并把对象还回slab
+    void retain() { m_refs.fetch_add(1, std::memory_order_relaxed); }
+    static void release(http_conn *conn);
+
+    void init(int sockfd, const sockaddr_in &addr, int epollfd, char *, int, int,
               string user, string passwd, string sqlname, bool use_ssl,
               std::shared_ptr<OpenSSLContext> opensslContext_,
               std::shared_ptr<SSLWrapper> ssl_wrapper,
@@ -120,14 +147,41 @@ public:
     {
         return &m_address;
     }
+    int get_sockfd() const
+    {
+        return m_sockfd;
+    }
     void initmysql_result(connection_pool *connPool);
-    int timer_flag;
-    int improv;
+    void post_completion();
+    // 请求行是否为图像分类/目标检测/语义分割的上传接口（/10、/11、/12），用于线程池分流
+    bool is_inference_request() const;
+    // 推理通道饱和时直接响应503并关闭连接，Retry-After告诉客户端多久之后重试
+    void reject_busy(int retry_after);
+    // 读缓冲区中已经有下一个请求（流水线）的数据、并且前面的响应已经全部发出，write()之后由调用者接着调用process()
+    bool has_pending_request() const;
+    // TLS握手是否已经完成（明文连接总是完成的）
+    bool handshake_done() const { return !use_ssl_ || is_connect_success; }
+    // socket就绪时推进TLS握手并按需要重新注册读/写事件，握手失败返回false
+    bool do_handshake();
+    int timer_flag;                // 工作线程读写失败时置1，由事件循环关闭连接
+    completion_queue *m_cq;        // 连接所属事件循环的完成队列
 
 private:
     void init();
+    // 重置一个请求的解析和响应状态，缓冲区留给下一个请求
+    void reset_request();
+    // 当前请求处理完，读缓冲区中后面的数据（流水线请求）移到开头；keep_output为true时保留写缓冲区中的响应
+    void next_request(bool keep_output);
+    // 请求完整，end为请求在读缓冲区中的结束位置
+    void finish_request(int end);
+    // 流水线：读缓冲区中还有请求时把刚生成的响应留在写缓冲区，和后面的响应一起发送
+    bool queue_response();
+    // 响应发送完之后：长连接开始下一个请求，否则返回false关闭连接
+    bool finish_response();
     // 从m_read_buf读取，并处理请求报文
     HTTP_CODE process_read();
+    // 从上次停下的位置继续解析已经收到的数据，请求完整时返回GET_REQUEST（可以重复调用）
+    HTTP_CODE parse_request();
     // 向m_write_buf写入响应报文数据
     bool process_write(HTTP_CODE ret);
     // 主状态机解析报文中的请求行数据
@@ -136,11 +190,39 @@ private:
     HTTP_CODE parse_headers(char *text);
     // 主状态机解析报文中的请求内容
     HTTP_CODE parse_content(char *text);
+    // 请求头解析完：上传请求打开m_upload_sink，其他请求检查包体能否放进读缓冲区
+    HTTP_CODE begin_content();
+    // 把读缓冲区中已经收到的上传包体写进m_upload_sink，腾出读缓冲区
+    HTTP_CODE stream_content();
+    // 上传请求（PUT /8、/10、/11、/12）URL中的文件名，其他请求返回NULL
+    const char *upload_filename() const;
     // 生成响应报文
     HTTP_CODE do_request();
     char *get_line() { return m_read_buf + m_start_line; };
     LINE_STATUS parse_line();
     void unmap();
+    // 把读缓冲区扩大到至少size字节，解析时保存的指向读缓冲区的指针一起搬过去
+    bool grow_read_buf(int size);
+    // 读缓冲区没有空间时按倍数（或者按Content-Length）扩大
+    bool reserve_read_buf();
+    // 读缓冲区扩大不了时先推进解析，上传包体写进文件之后继续读
+    bool make_read_room();
+    // 把写缓冲区扩大到至少size字节
+    bool grow_write_buf(int size);
+    // 读写缓冲区还给BufferPool
+    void release_buffers();
+    void release_read_buf();
+    void release_write_buf();
+    // 明文连接且文件不需要压缩时，直接用sendfile发送文件，不再mmap
+    bool use_sendfile();
+    bool write_sendfile();
+    // 请求文件的后缀名
+    std::string file_extension() const;
+    // 解析请求头时按Accept-Encoding（q值）协商出的压缩编码
+    ContentCompressor::EncodingType preferred_encoding() const;
+    // 压缩下一个窗口并把结果组装成一个chunk，作为下一段要发送的数据
+    bool fill_stream_chunk();
+    bool stream_active() const { return m_stream_compressor && m_stream_compressor->active(); }
     bool add_response(const char *format, ...);
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
@@ -152,8 +234,9 @@ private:
     bool add_content_disposition(const char *filename);
 
 public:
-    static int m_epollfd;
-    static int m_user_count;
+    int m_epollfd;                        // 连接所属事件循环的epoll fd
+    static std::atomic<int> m_user_count; // 多个反应堆线程共同维护
+    static object_pool<http_conn> &conn_pool(); // 所有连接对象所在的slab
     MYSQL *mysql;
     int m_state; // 读为0, 写为1
 
@@ -161,17 +244,25 @@ private:
     int m_sockfd;
     sockaddr_in m_address;
 
-    // 存储读取的请求报文数据
-    char m_read_buf[READ_BUFFER_SIZE];
+    // 存储读取的请求报文数据，数据之后总是保留一个'\0'
+    char *m_read_buf;
+    int m_read_size;
     // 缓冲区中m_read_buf中数据的最后一个字节的下一个位置
     int m_read_idx;
     // m_read_buf读取的位置m_checked_idx
     int m_checked_idx;
     // m_read_buf中已经解析的字符个数
     int m_start_line;
+    // 当前行第一个冒号在m_read_buf中的位置，-1表示还没有找到
+    int m_line_colon;
+    // 请求完整时请求末尾在m_read_buf中的位置，之后是下一个请求（流水线）的数据
+    int m_request_end;
+    // m_request_end处被'\0'覆盖之前的字节，开始下一个请求时恢复
+    char m_request_end_char;
 
     // 存储发出的响应报文数据
-    char m_write_buf[WRITE_BUFFER_SIZE];
+    char *m_write_buf;
+    int m_write_size;
     // 指示buffer中的长度
     int m_write_idx;
 
@@ -185,8 +276,13 @@ private:
     char *m_version;
     char *m_host;
     long m_content_length;
+    bool m_has_content_length; // 已经收到过Content-Length，再出现一次就是有歧义的请求
     bool m_linger;
     char *m_file_address;
+    const char *m_body_address; // 响应包体的起始地址（文件内容或者压缩后的数据）
+    int m_file_fd;        // sendfile路径下打开的文件，-1表示使用mmap路径
+    std::shared_ptr<const cached_file> m_cached_file; // 命中文件缓存时，m_file_address指向其中的数据
+    off_t m_file_offset;  // sendfile下一次发送的文件偏移
     struct stat m_file_stat;
     struct iovec m_iv[2];
     int m_iv_count;
@@ -211,6 +307,10 @@ private:
     char *m_upload_filename;
     long int m_file_size;
     std::string m_download;
+    UploadSink m_upload_sink; // 上传请求的包体不进读缓冲区，边收边写进文件
+    long m_body_received;     // 已经写进m_upload_sink的包体字节数
+    HTTP_CODE m_read_error;   // 读取时腾不出空间的原因（请求出错或者太大），由process_read返回
+    std::atomic<int> m_refs;  // 事件循环持有的一次（连接关闭时减掉）加上排队或处理中的任务数
 
     // session  + cookie
     static map<std::string, session_info> sessions;
@@ -230,8 +330,8 @@ private:
     bool add_session_cookie();
     static void cleanup_expired_sessions();
 
-    // 图像分类模块
-    Classification g_cls;
+    // 图像分类模块（推理对象只在推理请求中创建，init()时释放）
+    std::unique_ptr<Classification> m_cls;
     char *model_name;
     std::map<std::string, std::string> form_fields;
     bool process_image_classification(const char *image_path);
@@ -241,7 +341,7 @@ private:
     float iou_threshold;
     float conf_threshold;
     std::string imageHW; // 对于目标检测模型输入图像的大小要求
-    ObjectDetection g_obj;
+    std::unique_ptr<ObjectDetection> m_obj;
     bool is_objectDetect;
     // 保存结果图像
     char save_path[FILENAME_LEN];
@@ -252,18 +352,27 @@ private:
 
     // 语义分割系统实现
     bool is_segmentation;
-    Segmentation g_seg;
+    std::unique_ptr<Segmentation> m_seg;
     bool process_image_segmentation(const char *image_path);
 
     // ssl/tls协议
     std::shared_ptr<SSLWrapper> ssl_wrapper_; // 使用智能指针管理
     bool use_ssl_;
-    bool is_connect_success;
+    bool is_connect_success;                              // TLS握手已经完成
+    std::chrono::steady_clock::time_point m_handshake_start; // 连接建立的时间，用于统计握手耗时
 
-    // 数据压缩
-    ContentCompressor compressor_;
+    // 数据压缩：压缩结果由所有连接共享的CompressedCache保存
     bool is_compress_;
     std::string m_accept_encoding;
+    ContentCompressor::EncodingType m_encoding;         // 按Accept-Encoding协商出的编码
+    CompressedCache::buffer_ptr m_compressed_body;      // 本次响应使用的压缩数据
+    ContentCompressor::EncodingType m_sidecar_encoding; // 发送预先生成的旁路文件时的编码
+
+    // 流式压缩：大文件边压缩边发送，m_stream_buf只保存当前这一个chunk；压缩器只在流式响应时创建
+    std::unique_ptr<StreamCompressor> m_stream_compressor;
+    std::vector<char> m_stream_buf;
+    off_t m_stream_offset; // 下一个窗口在文件中的偏移
+    bool m_stream_done;    // 最后一个chunk（包括结束标记）已经生成
 
     // 信息控制面板
     bool is_admin_system;
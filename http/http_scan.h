@@ -0,0 +1,210 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+/*************************************************************
+*请求报文的行扫描和头部名称分类
+*   - scan_line在一次扫描中找到行结束符（'\r'或'\n'）和行内第一个冒号，
+*     x86上每次比较16字节（SSE2）或32字节（AVX2，运行时检测CPU），
+*     其他平台逐字节扫描
+*   - classify_header用编译期生成的完美哈希表把冒号之前的头部名称映射为
+*     HEADER_ID（一次哈希加一次比较），parse_headers按HEADER_ID分发
+*   - 只返回指向读缓冲区的位置，不拷贝数据
+**************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+enum HEADER_ID
+{
+    HEADER_UNKNOWN = 0,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_HOST,
+    HEADER_METHOD_OVERRIDE,
+    HEADER_CHUNK_NUMBER,
+    HEADER_TOTAL_CHUNKS,
+    HEADER_FILE_NAME,
+    HEADER_FILE_SIZE,
+    HEADER_MODEL_TYPE,
+    HEADER_IOU_THRESHOLD,
+    HEADER_CONF_THRESHOLD,
+    HEADER_IMAGE_SIZE,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_COOKIE,
+    HEADER_TRANSFER_ENCODING
+};
+
+struct header_entry
+{
+    const char *name;
+    size_t len;
+    HEADER_ID id;
+};
+
+constexpr size_t const_strlen(const char *s)
+{
+    return *s ? 1 + const_strlen(s + 1) : 0;
+}
+
+#define HTTP_HEADER(name, id) {name, const_strlen(name), id}
+// 服务器识别的头部，新增头部时加在这里，编译期检查哈希有没有冲突
+constexpr header_entry KNOWN_HEADERS[] = {
+    HTTP_HEADER("Connection", HEADER_CONNECTION),
+    HTTP_HEADER("Content-Length", HEADER_CONTENT_LENGTH),
+    HTTP_HEADER("Host", HEADER_HOST),
+    HTTP_HEADER("X-HTTP-Method-Override", HEADER_METHOD_OVERRIDE),
+    HTTP_HEADER("X-Chunk-Number", HEADER_CHUNK_NUMBER),
+    HTTP_HEADER("X-Total-Chunks", HEADER_TOTAL_CHUNKS),
+    HTTP_HEADER("X-File-Name", HEADER_FILE_NAME),
+    HTTP_HEADER("X-File-Size", HEADER_FILE_SIZE),
+    HTTP_HEADER("X-Model-Type", HEADER_MODEL_TYPE),
+    HTTP_HEADER("X-IOU-Threshold", HEADER_IOU_THRESHOLD),
+    HTTP_HEADER("X-Confidence-Threshold", HEADER_CONF_THRESHOLD),
+    HTTP_HEADER("X-Image-Size", HEADER_IMAGE_SIZE),
+    HTTP_HEADER("Accept-Encoding", HEADER_ACCEPT_ENCODING),
+    HTTP_HEADER("Cookie", HEADER_COOKIE),
+    HTTP_HEADER("Transfer-Encoding", HEADER_TRANSFER_ENCODING),
+};
+#undef HTTP_HEADER
+
+/*头部名称的完美哈希：不区分大小写的FNV-1a，取高HEADER_TABLE_BITS位作为槽位。
+  KNOWN_HEADERS在编译期放进各自的槽位，有两个名称落到同一个槽位时static_assert报错，
+  这时调整HEADER_HASH_SEED（或者增大HEADER_TABLE_BITS）直到没有冲突*/
+static const unsigned HEADER_TABLE_BITS = 6;
+static const unsigned HEADER_TABLE_SIZE = 1u << HEADER_TABLE_BITS;
+static const uint32_t HEADER_HASH_SEED = 2166136261u + 3;
+
+constexpr char ascii_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+constexpr unsigned header_hash(const char *name, size_t len)
+{
+    uint32_t h = HEADER_HASH_SEED;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ (unsigned char)ascii_lower(name[i])) * 16777619u;
+    return h >> (32 - HEADER_TABLE_BITS);
+}
+
+struct header_table
+{
+    header_entry slots[HEADER_TABLE_SIZE];
+    bool collision;
+};
+
+constexpr header_table build_header_table()
+{
+    header_table table{};
+    for (const header_entry &entry : KNOWN_HEADERS)
+    {
+        header_entry &slot = table.slots[header_hash(entry.name, entry.len)];
+        if (slot.name)
+            table.collision = true;
+        slot = entry;
+    }
+    return table;
+}
+
+constexpr header_table HEADER_TABLE = build_header_table();
+static_assert(!HEADER_TABLE.collision, "header names collide in HEADER_TABLE, change HEADER_HASH_SEED");
+
+// 头部名称（不含冒号）为[name, name + len)时对应的HEADER_ID，不区分大小写：
+// 一次哈希定位槽位，再和槽位中的名称比较一次
+inline HEADER_ID classify_header(const char *name, size_t len)
+{
+    const header_entry &entry = HEADER_TABLE.slots[header_hash(name, len)];
+    if (entry.len != len || strncasecmp(name, entry.name, len) != 0)
+        return HEADER_UNKNOWN;
+    return entry.id;
+}
+
+// 逐字节扫描，也用于处理SIMD扫描剩下的不足一个向量的尾部
+inline const char *scan_line_scalar(const char *p, const char *end, const char **colon)
+{
+    for (; p < end; ++p)
+    {
+        char c = *p;
+        if (c == '\r' || c == '\n')
+            return p;
+        if (c == ':' && colon && !*colon)
+            *colon = p;
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+// eol为本次向量中行结束符的位图，只记录行结束符之前的冒号
+inline void record_colon(const char *p, unsigned colon_mask, unsigned eol_mask, const char **colon)
+{
+    if (eol_mask)
+        colon_mask &= (eol_mask & (0u - eol_mask)) - 1;
+    if (colon_mask)
+        *colon = p + __builtin_ctz(colon_mask);
+}
+
+inline const char *scan_line_sse2(const char *p, const char *end, const char **colon)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i co = _mm_set1_epi8(':');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned eol_mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        if (colon && !*colon)
+            record_colon(p, _mm_movemask_epi8(_mm_cmpeq_epi8(v, co)), eol_mask, colon);
+        if (eol_mask)
+            return p + __builtin_ctz(eol_mask);
+    }
+    return scan_line_scalar(p, end, colon);
+}
+
+__attribute__((target("avx2"))) inline const char *scan_line_avx2(const char *p, const char *end, const char **colon)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i co = _mm256_set1_epi8(':');
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned eol_mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (colon && !*colon)
+            record_colon(p, _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, co)), eol_mask, colon);
+        if (eol_mask)
+            return p + __builtin_ctz(eol_mask);
+    }
+    return scan_line_sse2(p, end, colon);
+}
+#endif
+
+typedef const char *(*scan_line_fn)(const char *, const char *, const char **);
+
+// 按CPU支持的指令集选择扫描函数
+inline scan_line_fn select_scan_line()
+{
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return scan_line_avx2;
+    return scan_line_sse2;
+#else
+    return scan_line_scalar;
+#endif
+}
+
+/*返回[begin, end)中第一个'\r'或'\n'的位置，没有时返回end；
+  colon不为NULL且*colon为NULL时，顺便记录行结束符之前的第一个冒号*/
+inline const char *scan_line(const char *begin, const char *end, const char **colon)
+{
+    static const scan_line_fn fn = select_scan_line();
+    return fn(begin, end, colon);
+}
+
+#endif // HTTP_SCAN_H
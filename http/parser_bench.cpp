@@ -0,0 +1,164 @@
+/*************************************************************
+*请求解析微基准测试：逐字节找\r\n + strncasecmp链 与 scan_line + classify_header
+*请求样本按服务器实际接收的几类请求构造：
+*   static  —— 浏览器请求静态页面（较多的标准头部和Cookie）
+*   login   —— 表单登录POST
+*   upload  —— 推理接口的分块上传PUT（X-*自定义头部）
+*   bench   —— 压测工具的最小GET请求
+*每种请求重复解析，统计每个请求的平均耗时
+*
+*   g++ -O2 -std=c++14 parser_bench.cpp -o parser_bench
+*   ./parser_bench
+**************************************************************/
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+#include "http_scan.h"
+
+static const char *SAMPLES[][2] = {
+    {"static",
+     "GET /picture.html HTTP/1.1\r\n"
+     "Host: 10.16.110.157:9006\r\n"
+     "Connection: keep-alive\r\n"
+     "Cache-Control: max-age=0\r\n"
+     "Upgrade-Insecure-Requests: 1\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+     "Referer: https://10.16.110.157:9006/welcome.html\r\n"
+     "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+     "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+     "Cookie: theme=dark; session_id=0123456789abcdef0123456789abcdef; lang=zh\r\n"
+     "\r\n"},
+    {"login",
+     "POST /2CGISQL.cgi HTTP/1.1\r\n"
+     "Host: 10.16.110.157:9006\r\n"
+     "Connection: keep-alive\r\n"
+     "Content-Length: 28\r\n"
+     "Content-Type: application/x-www-form-urlencoded\r\n"
+     "Origin: https://10.16.110.157:9006\r\n"
+     "Accept-Encoding: gzip, deflate\r\n"
+     "\r\n"},
+    {"upload",
+     "PUT /11 HTTP/1.1\r\n"
+     "Host: 10.16.110.157:9006\r\n"
+     "Connection: keep-alive\r\n"
+     "Content-Length: 262144\r\n"
+     "Content-Type: application/octet-stream\r\n"
+     "X-Chunk-Number: 3\r\n"
+     "X-Total-Chunks: 12\r\n"
+     "X-File-Name: street_view_1920x1080.jpg\r\n"
+     "X-File-Size: 3068912\r\n"
+     "X-Model-Type: yolov8s\r\n"
+     "X-IOU-Threshold: 0.45\r\n"
+     "X-Confidence-Threshold: 0.25\r\n"
+     "X-Image-Size: 640\r\n"
+     "Accept-Encoding: gzip, deflate, br\r\n"
+     "\r\n"},
+    {"bench",
+     "GET / HTTP/1.1\r\n"
+     "Host: localhost:9006\r\n"
+     "Connection: keep-alive\r\n"
+     "\r\n"},
+};
+
+// 原来parse_headers中按顺序比较的头部前缀
+static const char *OLD_PREFIXES[] = {
+    "Connection:", "Content-length:", "Host:", "X-HTTP-Method-Override:", "X-Chunk-Number:",
+    "X-Total-Chunks:", "X-File-Name:", "X-File-Size:", "X-Model-Type:", "X-IOU-Threshold:",
+    "X-Confidence-Threshold:", "X-Image-Size:", "Accept-Encoding:", "Cookie:"};
+
+static long g_sink = 0;
+
+// 原来的做法：逐字节找\r\n，再逐个strncasecmp
+static void parse_old(const char *buf, size_t len)
+{
+    size_t start = 0;
+    for (size_t i = 0; i + 1 < len; ++i)
+    {
+        if (buf[i] != '\r' || buf[i + 1] != '\n')
+            continue;
+        const char *line = buf + start;
+        if (start > 0 && i > start)
+        {
+            int id = 0;
+            for (size_t k = 0; k < sizeof(OLD_PREFIXES) / sizeof(OLD_PREFIXES[0]); ++k)
+            {
+                if (strncasecmp(line, OLD_PREFIXES[k], strlen(OLD_PREFIXES[k])) == 0)
+                {
+                    id = k + 1;
+                    break;
+                }
+            }
+            g_sink += id;
+        }
+        start = ++i + 1;
+    }
+}
+
+// 现在的做法：一次扫描找到行结束符和冒号，再按名称分类
+static void parse_new(const char *buf, size_t len, scan_line_fn scan)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    bool first = true;
+    while (p < end)
+    {
+        const char *colon = NULL;
+        const char *eol = scan(p, end, &colon);
+        if (eol == end)
+            break;
+        if (!first && eol > p && colon)
+            g_sink += classify_header(p, colon - p);
+        first = false;
+        p = eol + 2;
+    }
+}
+
+template <typename Fn>
+static double run(Fn fn, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main()
+{
+    const int iterations = 1000000;
+    std::vector<std::pair<const char *, scan_line_fn>> scanners;
+    scanners.push_back(std::make_pair("scalar", scan_line_scalar));
+#ifdef HTTP_SCAN_X86
+    scanners.push_back(std::make_pair("sse2", scan_line_sse2));
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        scanners.push_back(std::make_pair("avx2", scan_line_avx2));
+#endif
+
+    printf("%-8s %6s %10s", "request", "bytes", "old(ns)");
+    for (size_t k = 0; k < scanners.size(); ++k)
+        printf(" %8s(ns)", scanners[k].first);
+    printf("\n");
+
+    for (size_t s = 0; s < sizeof(SAMPLES) / sizeof(SAMPLES[0]); ++s)
+    {
+        std::string request(SAMPLES[s][1]);
+        const char *buf = request.data();
+        size_t len = request.size();
+
+        printf("%-8s %6zu %10.1f", SAMPLES[s][0], len, run([&]() { parse_old(buf, len); }, iterations));
+        for (size_t k = 0; k < scanners.size(); ++k)
+        {
+            scan_line_fn scan = scanners[k].second;
+            printf(" %12.1f", run([&]() { parse_new(buf, len, scan); }, iterations));
+        }
+        printf("\n");
+    }
+    return g_sink == 0;
+}
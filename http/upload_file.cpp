@@ -8,83 +8,86 @@ bool UploadFile::is_valid_path(const char *path)
            strstr(path, "%2e%2e") == nullptr;
 }
 
-bool UploadFile::save_uploaded_file(const char *filename, const char *data, size_t len)
+bool UploadSink::open(const std::string &path)
 {
-    char dir_path[FILENAME_LEN];
-    strcpy(dir_path, doc_root);
-    strcat(dir_path, "/uploads");
+    abort();
+    m_path = path;
+    m_tmp_path = path + ".uploading";
+    m_fd = ::open(m_tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    m_written = 0;
+    return m_fd >= 0;
+}
 
-    // 创建上传目录（如果不存在）
-    struct stat st;
-    if (stat(dir_path, &st))
+bool UploadSink::write(const char *data, size_t len)
+{
+    while (len > 0)
     {
-        mkdir(dir_path, 0755);
+        ssize_t n = ::write(m_fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+        m_written += n;
     }
+    return true;
+}
 
-    char full_path[FILENAME_LEN];
-    snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, filename);
-
-    printf("upload file: %s\n", full_path);
-
-    int fd = open(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0)
+bool UploadSink::finish()
+{
+    if (m_fd < 0)
         return false;
+    bool ok = close(m_fd) == 0 && rename(m_tmp_path.c_str(), m_path.c_str()) == 0;
+    m_fd = -1;
+    if (!ok)
+        unlink(m_tmp_path.c_str());
+    return ok;
+}
 
-    ssize_t written = ::write(fd, data, len);
-    close(fd);
-    return written == static_cast<ssize_t>(len);
+void UploadSink::abort()
+{
+    if (m_fd < 0)
+        return;
+    close(m_fd);
+    unlink(m_tmp_path.c_str());
+    m_fd = -1;
 }
 
 /**
- * 保存上传的文件分块
+ * 为上传的文件打开写入端
  * @param filename 原始文件名
- * @param data 分块数据
- * @param len 分块长度
  * @param chunk_num 分块序号
- * @param total_chunks 总分块数
+ * @param total_chunks 总分块数，大于1时写入分块临时目录，否则直接写入uploads目录
  * @return 是否成功
  */
-bool UploadFile::save_uploaded_chunk(const char *filename, const char *data, size_t len,
-                                     int chunk_num, int total_chunks)
+bool UploadFile::open_sink(UploadSink &sink, const char *filename, int chunk_num, int total_chunks)
 {
-    // 创建临时目录存放分块
-    char chunk_dir[FILENAME_LEN];
-    // printf("doc root: %s\n", doc_root);
-    snprintf(chunk_dir, sizeof(chunk_dir), "%s/uploads_chunks", doc_root);
+    // 分块放在临时目录中，等最后一个分块到达后再合并
+    char dir_path[FILENAME_LEN];
+    snprintf(dir_path, sizeof(dir_path), "%s/%s", doc_root, total_chunks > 1 ? "uploads_chunks" : "uploads");
 
-    // 确保临时目录存在
+    // 创建上传目录（如果不存在）
     struct stat st;
-    if (stat(chunk_dir, &st))
-    {
-        if (mkdir(chunk_dir, 0755))
-        {
-            LOG_ERROR("Cannot create chunk directory: %s", chunk_dir);
-            return false;
-        }
-    }
-
-    // 生成分块临时文件名
-    char chunk_path[FILENAME_LEN];
-    snprintf(chunk_path, sizeof(chunk_path), "%s/%s.part%d", chunk_dir, filename, chunk_num);
-
-    // 写入分块文件
-    FILE *fp = fopen(chunk_path, "wb");
-    if (!fp)
+    if (stat(dir_path, &st) && mkdir(dir_path, 0755))
     {
-        LOG_ERROR("Cannot open chunk file %s: %s", chunk_path, strerror(errno));
+        LOG_ERROR("Cannot create upload directory: %s", dir_path);
         return false;
     }
 
-    size_t written = fwrite(data, 1, len, fp);
-    fclose(fp);
+    char full_path[FILENAME_LEN];
+    if (total_chunks > 1)
+        snprintf(full_path, sizeof(full_path), "%s/%s.part%d", dir_path, filename, chunk_num);
+    else
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, filename);
 
-    if (written != len)
+    if (!sink.open(full_path))
     {
-        LOG_ERROR("Incomplete write to chunk file %s: %zu/%zu", chunk_path, written, len);
+        LOG_ERROR("Cannot open upload file %s: %s", full_path, strerror(errno));
         return false;
     }
-
-    LOG_INFO("Saved chunk %d/%d of %s (%zu bytes)", chunk_num + 1, total_chunks, filename, len);
     return true;
 }
 
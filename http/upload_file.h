@@ -27,9 +27,35 @@
 #include <array>
 #include <set>
 #include <iostream>
+#include <string>
 
 #include "../log/log.h"
 
+// 上传包体的写入端：请求头解析完就打开，包体边收边写进临时文件，
+// 全部收完之后finish改名为目标文件；请求没有完成（连接断开、出错）时abort删除临时文件
+class UploadSink
+{
+public:
+    UploadSink() : m_fd(-1), m_written(0) {}
+    ~UploadSink() { abort(); }
+
+    UploadSink(const UploadSink &) = delete;
+    UploadSink &operator=(const UploadSink &) = delete;
+
+    bool open(const std::string &path);
+    bool write(const char *data, size_t len);
+    bool finish();
+    void abort();
+    bool is_open() const { return m_fd >= 0; }
+    size_t written() const { return m_written; }
+
+private:
+    int m_fd;
+    size_t m_written;
+    std::string m_path;     // 目标文件
+    std::string m_tmp_path; // 接收过程中写入的临时文件
+};
+
 class UploadFile
 {
 
@@ -57,10 +83,9 @@ public:
     static const int WRITE_BUFFER_SIZE = 1024 * 32;
     static const size_t MAX_UPLOAD_SIZE = 10 * 1024 * 1024; // 10MB
     // 上传文件模块
-    bool save_uploaded_file(const char *filename, const char *data, size_t len);
     bool is_valid_path(const char *path);
-    bool save_uploaded_chunk(const char *filename, const char *data, size_t len,
-                             int chunk_num, int total_chunks);
+    // 为上传的文件（total_chunks > 1时为第chunk_num个分块）打开写入端
+    bool open_sink(UploadSink &sink, const char *filename, int chunk_num, int total_chunks);
     void cleanup_chunks();
     bool is_all_digits(const char *str);
     bool merge_uploaded_file(const char *filename, int total_chunks);
@@ -1,7 +1,11 @@
 #include "monitor_system.h"
+#include "../buffer/buffer_pool.h"
 #include <sstream>
 #include <iomanip>
 
+const uint64_t MonitorSystem::HANDSHAKE_BUCKETS_MS[HANDSHAKE_BUCKET_COUNT - 1] = {
+    1, 5, 10, 25, 50, 100, 250, 500, 1000};
+
 // 采用懒汉式单例模式（线程安全）
 MonitorSystem &MonitorSystem::instance()
 {
@@ -12,8 +16,13 @@ MonitorSystem &MonitorSystem::instance()
 MonitorSystem::MonitorSystem() : active_connections_(0), total_connections_(0),
                                  requests_total_(0), request_duration_ms_(0),
                                  read_bytes_total_(0), write_bytes_total_(0),
-                                 ssl_handshakes_(0), ssl_errors_(0)
+                                 ssl_handshakes_(0), ssl_errors_(0),
+                                 handshake_completed_(0), handshake_failed_(0), handshake_resumed_(0),
+                                 handshake_duration_us_(0), ktls_responses_(0), ktls_bytes_(0),
+                                 file_cache_hits_(0), file_cache_misses_(0)
 {
+    for (auto &bucket : handshake_buckets_)
+        bucket = 0;
 
     for (auto &method : requests_by_method_)
         method = 0;
@@ -64,6 +73,47 @@ void MonitorSystem::record_request_duration(uint64_t duration_ms)
     request_duration_ms_ += duration_ms;
 }
 
+void MonitorSystem::record_file_cache(bool hit)
+{
+    if (hit)
+        file_cache_hits_++;
+    else
+        file_cache_misses_++;
+}
+
+void MonitorSystem::record_compression(const std::string &type, size_t in, size_t out, uint64_t time_us)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    compression_stat &stat = compression_by_type_[type];
+    stat.count++;
+    stat.bytes_in += in;
+    stat.bytes_out += out;
+    stat.time_us += time_us;
+}
+
+void MonitorSystem::record_ssl_handshake(bool success, bool resumed, uint64_t duration_us)
+{
+    if (!success)
+    {
+        handshake_failed_++;
+        return;
+    }
+    handshake_completed_++;
+    if (resumed)
+        handshake_resumed_++;
+    handshake_duration_us_ += duration_us;
+    int bucket = 0;
+    while (bucket < HANDSHAKE_BUCKET_COUNT - 1 && duration_us > HANDSHAKE_BUCKETS_MS[bucket] * 1000)
+        ++bucket;
+    handshake_buckets_[bucket]++;
+}
+
+void MonitorSystem::record_ktls_sendfile(size_t bytes)
+{
+    ktls_responses_++;
+    ktls_bytes_ += bytes;
+}
+
 void MonitorSystem::record_bytes_transferred(size_t read_bytes, size_t written_bytes)
 {
     read_bytes_total_ += read_bytes;
@@ -105,7 +155,59 @@ std::string MonitorSystem::get_metrics_json() const
 
     json << "\"ssl\":{";
     json << "\"handshakes\":" << ssl_handshakes_ << ",";
-    json << "\"errors\":" << ssl_errors_;
+    json << "\"errors\":" << ssl_errors_ << ",";
+    // 握手耗时直方图，键为桶的上限（毫秒），不是累计值
+    json << "\"handshake\":{";
+    json << "\"completed\":" << handshake_completed_ << ",";
+    json << "\"failed\":" << handshake_failed_ << ",";
+    json << "\"resumed\":" << handshake_resumed_ << ",";
+    json << "\"full\":" << handshake_completed_ - handshake_resumed_ << ",";
+    json << "\"avg_ms\":" << (handshake_completed_ > 0 ? handshake_duration_us_ / 1000.0 / handshake_completed_ : 0.0) << ",";
+    json << "\"latency_ms\":{";
+    for (int i = 0; i < HANDSHAKE_BUCKET_COUNT; ++i)
+    {
+        if (i > 0)
+            json << ",";
+        if (i < HANDSHAKE_BUCKET_COUNT - 1)
+            json << "\"" << HANDSHAKE_BUCKETS_MS[i] << "\":" << handshake_buckets_[i];
+        else
+            json << "\"+Inf\":" << handshake_buckets_[i];
+    }
+    json << "}";
+    json << "},";
+    json << "\"ktls\":{";
+    json << "\"responses\":" << ktls_responses_ << ",";
+    json << "\"bytes\":" << ktls_bytes_;
+    json << "}";
+    json << "},";
+
+    json << "\"file_cache\":{";
+    json << "\"hits\":" << file_cache_hits_ << ",";
+    json << "\"misses\":" << file_cache_misses_;
+    json << "},";
+
+    // 连接读写缓冲区：in_use为借给连接的字节数，allocated还包括池中空闲的缓冲区
+    json << "\"buffers\":{";
+    json << "\"in_use\":" << BufferPool::instance().in_use_bytes() << ",";
+    json << "\"allocated\":" << BufferPool::instance().allocated_bytes();
+    json << "},";
+
+    // ratio为压缩后/压缩前，us_per_mb为每MB输入的压缩耗时
+    json << "\"compression\":{";
+    for (std::map<std::string, compression_stat>::const_iterator it = compression_by_type_.begin();
+         it != compression_by_type_.end(); ++it)
+    {
+        const compression_stat &stat = it->second;
+        if (it != compression_by_type_.begin())
+            json << ",";
+        json << "\"" << it->first << "\":{";
+        json << "\"count\":" << stat.count << ",";
+        json << "\"bytes_in\":" << stat.bytes_in << ",";
+        json << "\"bytes_out\":" << stat.bytes_out << ",";
+        json << "\"ratio\":" << (stat.bytes_in > 0 ? (double)stat.bytes_out / stat.bytes_in : 0.0) << ",";
+        json << "\"us_per_mb\":" << (stat.bytes_in > 0 ? (double)stat.time_us * 1024 * 1024 / stat.bytes_in : 0.0);
+        json << "}";
+    }
     json << "}";
     json << "}";
 
@@ -24,6 +24,13 @@ public:
     void record_request_end(int method, int status, bool ssl_success);
     void record_bytes_transferred(size_t read_bytes, size_t written_bytes);
     void record_request_duration(uint64_t duration_ms);
+    void record_file_cache(bool hit);
+    // 记录一次压缩：type为文件后缀名，in/out为压缩前后的字节数，time_us为耗时
+    void record_compression(const std::string &type, size_t in, size_t out, uint64_t time_us);
+    // 记录一次TLS握手的结果、是否为会话复用，以及从连接建立到握手结束的耗时
+    void record_ssl_handshake(bool success, bool resumed, uint64_t duration_us);
+    // 记录一个通过kTLS（SSL_sendfile）发送的文件响应，bytes为文件部分的字节数
+    void record_ktls_sendfile(size_t bytes);
 
     // 管理接口
     std::string get_metrics_json() const;
@@ -57,6 +64,34 @@ private:
     std::atomic<uint64_t> ssl_handshakes_;
     std::atomic<uint64_t> ssl_errors_;
 
+    // TLS握手耗时直方图，HANDSHAKE_BUCKETS_MS为各个桶的上限（毫秒），最后一个桶为+Inf
+    static const int HANDSHAKE_BUCKET_COUNT = 10;
+    static const uint64_t HANDSHAKE_BUCKETS_MS[HANDSHAKE_BUCKET_COUNT - 1];
+    std::atomic<uint64_t> handshake_buckets_[HANDSHAKE_BUCKET_COUNT];
+    std::atomic<uint64_t> handshake_completed_;
+    std::atomic<uint64_t> handshake_failed_;
+    std::atomic<uint64_t> handshake_resumed_; // 通过会话缓存或票据复用的握手
+    std::atomic<uint64_t> handshake_duration_us_;
+
+    // kTLS零拷贝发送的文件响应
+    std::atomic<uint64_t> ktls_responses_;
+    std::atomic<uint64_t> ktls_bytes_;
+
+    // 静态文件缓存指标
+    std::atomic<uint64_t> file_cache_hits_;
+    std::atomic<uint64_t> file_cache_misses_;
+
+    // 压缩指标，按文件类型统计压缩率和耗时，用于调整压缩策略
+    struct compression_stat
+    {
+        uint64_t count;
+        uint64_t bytes_in;
+        uint64_t bytes_out;
+        uint64_t time_us;
+        compression_stat() : count(0), bytes_in(0), bytes_out(0), time_us(0) {}
+    };
+    std::map<std::string, compression_stat> compression_by_type_;
+
     // 线程安全
     mutable std::mutex mutex_;
 };
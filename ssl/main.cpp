@@ -195,7 +195,10 @@ int main(int argc, char *argv[])
             std::cout << "recv: " << buf << std::endl;
 
             // const char *response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n<h1>HTTPS Server</h1>";
-            wrapper.write(content.c_str(), content.size());
+            struct iovec iov;
+            iov.iov_base = (void *)content.c_str();
+            iov.iov_len = content.size();
+            wrapper.writev(&iov, 1);
 
             wrapper.shutdown();
         }
@@ -7,6 +7,8 @@
 #include <string>
 #include <sys/stat.h>
 
+#include "ticket_keys.h"
+
 using namespace std;
 
 class OpenSSLContext
@@ -84,8 +86,37 @@ public:
         {
             throw std::runtime_error("Private key does not match certificate");
         }
+
+        // 会话复用：老客户端重连时走简化握手，省去证书校验和密钥交换的开销
+        // 服务端会话缓存（TLS 1.2的session id）
+        const unsigned char sid_ctx[] = "WebServer";
+        SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+        SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+        // 会话票据（TLS 1.2的session ticket和TLS 1.3的PSK），票据密钥定期轮换
+        SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+        TicketKeyRing::instance().install(ctx);
     }
 
+    /*开启内核TLS（kTLS）：握手完成之后OpenSSL把会话密钥交给内核，
+      记录层的加密由内核完成，文件可以用SSL_sendfile零拷贝发送。
+      只对之后创建的连接生效；内核不支持（没有加载tls模块）或者协商出的
+      加密套件内核不支持时，连接自动退回用户态加密。
+      返回false表示当前OpenSSL版本没有kTLS*/
+    bool enable_ktls()
+    {
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static const long SESSION_CACHE_SIZE = 20480; // 服务端缓存的会话数
+    static const long SESSION_TIMEOUT = TicketKeyRing::KEY_COUNT * TicketKeyRing::KEY_LIFETIME; // 会话有效期（秒），不超过票据密钥的保留时间
+
     bool validate_key_permissions(const std::string &key_path)
     {
         struct stat st;
@@ -1,41 +1,13 @@
 #include "ssl_wrapper.h"
 #include <stdexcept>
 
-// 在SSL握手前检查连接是否仍然活跃
-bool SSLWrapper::is_connection_alive(int sockfd)
-{
-    struct timeval timeout = {1, 0}; // 1秒超时
-    fd_set read_fds;
-    // 清空文件描述符
-    FD_ZERO(&read_fds);
-    // 将一个特定的文件描述符 sockfd 加入到集合 read_fds 中
-    FD_SET(sockfd, &read_fds);
-
-    // 检查是否有数据可读或错误；
-    // 调用 select 函数来同步监视多个文件描述符的状态变化。这里它被用来监视一个 socket 是否可读，并带有超时限制。
-    int result = select(sockfd + 1, &read_fds, nullptr, nullptr, &timeout);
-    if (result < 0)
-        return false; // 错误
-    if (result == 0)
-        return true; // 超时，连接仍存在
+// std::chrono::milliseconds按引用接收参数，需要类外定义（C++17之前没有inline变量）
+const int SSLWrapper::RECORD_IDLE_RESET_MS;
 
-    // 有数据可读，检查是否是FIN包
-    char buf[1];
-    if (recv(sockfd, buf, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
-    {
-        return false; // 收到FIN
-    }
-    return true;
-}
-
-SSLWrapper::SSLWrapper(int sockfd, SSL_CTX *ctx) : sockfd_(sockfd), ctx_(ctx), ssl_(nullptr)
+// 构造时只创建SSL对象，握手由handshake()在socket就绪时推进，不在accept路径上等待客户端
+SSLWrapper::SSLWrapper(int sockfd, SSL_CTX *ctx) : ctx_(ctx), ssl_(nullptr), sockfd_(sockfd),
+                                                   retry_buf_(nullptr), retry_len_(0), boost_bytes_(0)
 {
-
-    // 检查连接是否仍然有效
-    if (!is_connection_alive(sockfd))
-    {
-        throw std::runtime_error("Connection already closed by client");
-    }
     // 初始化SSL库，加载私钥和证书
     if (!ctx_)
     {
@@ -47,6 +19,9 @@ SSLWrapper::SSLWrapper(int sockfd, SSL_CTX *ctx) : sockfd_(sockfd), ctx_(ctx), s
         throw_ssl_error("Failed to create SSL object");
     }
     SSL_set_fd(ssl_, sockfd_);
+    SSL_set_accept_state(ssl_);
+    // 非阻塞socket上SSL_write返回WANT_WRITE之后，重试时缓冲区地址可以变化
+    SSL_set_mode(ssl_, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 }
 
 SSLWrapper::~SSLWrapper()
@@ -86,76 +61,35 @@ void SSLWrapper::print_detailed_ssl_errors(SSL *ssl, int ret)
     }
 }
 
-bool SSLWrapper::accept()
+SSLWrapper::HANDSHAKE_STATE SSLWrapper::handshake()
 {
-    // 再次检查连接状态
-    if (!is_connection_alive(sockfd_))
-    {
-        return false;
-    }
-    // 预检查套接字状态
-    int socket_error = 0;
-    socklen_t error_len = sizeof(socket_error);
-    if (getsockopt(sockfd_, SOL_SOCKET, SO_ERROR, &socket_error, &error_len) < 0)
-    {
-        std::cerr << __FILE__ << " " << __LINE__ << " " << "getsockopt error: " << strerror(errno) << std::endl;
-        return false;
-    }
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl_);
+    if (ret == 1)
+        return HANDSHAKE_DONE;
 
-    if (socket_error != 0)
-    {
-        std::cerr << __FILE__ << " " << __LINE__ << " " << "Socket error before SSL_accept: "
-                  << strerror(socket_error) << std::endl;
-        return false;
-    }
+    int ssl_err = SSL_get_error(ssl_, ret);
+    if (ssl_err == SSL_ERROR_WANT_READ)
+        return HANDSHAKE_WANT_READ;
+    if (ssl_err == SSL_ERROR_WANT_WRITE)
+        return HANDSHAKE_WANT_WRITE;
 
-    try
-    {
-        std::cout << __FILE__ << " " << __LINE__ << " " << "SSL state: " << SSL_state_string_long(ssl_) << std::endl;
-        int count = 3;
-        while (count--)
-        {
-            int ret = SSL_accept(ssl_);
-            if (ret > 0)
-            {
-                std::cout << "握手成功 - 最终状态: " << SSL_state_string_long(ssl_) << "\n"
-                          << "协商协议: " << SSL_get_version(ssl_) << "\n"
-                          << "使用加密套件: " << SSL_get_cipher(ssl_) << "\n"
-                          << "证书验证结果: " << SSL_get_verify_result(ssl_) << std::endl;
-
-                return true;
-            }
-            if (ret <= 0)
-            {
-                int ssl_err = SSL_get_error(ssl_, ret);
-                if (ssl_err == SSL_ERROR_WANT_READ || ssl_err == SSL_ERROR_WANT_WRITE)
-                {
-                    continue; // 非致命错误，继续重试
-                }
+    // 客户端中途断开、协议错误等
+    print_detailed_ssl_errors(ssl_, ret);
+    return HANDSHAKE_FAILED;
+}
 
-                // 详细错误处理
-                switch (ssl_err)
-                {
-                case SSL_ERROR_WANT_READ:
-                    std::cerr << __FILE__ << " " << __LINE__ << " " << "SSL需要更多读取数据" << std::endl;
-                    break;
-                case SSL_ERROR_WANT_WRITE:
-                    std::cerr << __FILE__ << " " << __LINE__ << " " << "SSL需要更多写入数据" << std::endl;
-                    break;
-                default:
-                    print_detailed_ssl_errors(ssl_, ret);
-                    break;
-                    // return false;
-                }
-            }
-        }
-    }
-    catch (const std::exception &e)
+bool SSLWrapper::accept()
+{
+    // 阻塞socket上SSL_do_handshake会一直等到握手结束，WANT_READ/WANT_WRITE只在被信号打断时出现
+    while (true)
     {
-        std::cerr << __FILE__ << " " << __LINE__ << " " << "SSL接受异常: " << e.what() << std::endl;
-        return false;
+        HANDSHAKE_STATE state = handshake();
+        if (state == HANDSHAKE_DONE)
+            return true;
+        if (state == HANDSHAKE_FAILED)
+            return false;
     }
-    return false;
 }
 
 int SSLWrapper::read(void *buf, size_t len)
@@ -168,77 +102,153 @@ int SSLWrapper::read(void *buf, size_t len)
         {
             return 0; // 连接关闭
         }
+        // 非阻塞socket上暂时没有完整的记录可读，和recv一样返回EAGAIN
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
         throw_ssl_error("SSL read error");
     }
     printf("%s %d  recv data is successfully %s\n", __FILE__, __LINE__, buf);
     return bytes;
 }
 
-// 将SSL加密后的数据从writeBio刷新到socket
-void SSLWrapper::flushSslOut()
+int SSLWrapper::next_record(const struct iovec *iov, int iovcnt, size_t skip, const char *&buf)
 {
-    char buf[4096];
-    int pending;
+    // 跳过已经发送的部分
+    int i = 0;
+    while (i < iovcnt && skip >= iov[i].iov_len)
+    {
+        skip -= iov[i].iov_len;
+        ++i;
+    }
+    if (i == iovcnt)
+        return 0;
+
+    size_t limit = record_size();
+    const char *base = static_cast<const char *>(iov[i].iov_base) + skip;
+    size_t avail = iov[i].iov_len - skip;
+    bool more = false;
+    for (int j = i + 1; j < iovcnt; ++j)
+        more = more || iov[j].iov_len > 0;
+
+    // 当前这一段够一个记录，或者后面没有数据了，直接从原来的内存加密，不拷贝
+    if (avail >= limit || !more)
+    {
+        buf = base;
+        return avail < limit ? avail : limit;
+    }
 
-    // 检查BIO中是否有待发送的加密数据
-    while ((pending = BIO_pending(writeBio_)) > 0)
+    // 响应头这样的小段和后面的包体拼成一个记录，避免一个很小的记录单独占一个报文段
+    coalesce_buf_.resize(limit);
+    size_t filled = 0;
+    for (; i < iovcnt && filled < limit; ++i)
     {
-        int bytes = BIO_read(writeBio_, buf, std::min(pending, static_cast<int>(sizeof(buf))));
-        if (bytes > 0)
+        size_t n = avail < limit - filled ? avail : limit - filled;
+        memcpy(&coalesce_buf_[filled], base, n);
+        filled += n;
+        if (i + 1 < iovcnt)
         {
-            // 实际发送到网络（需处理EAGAIN等错误）
-            int sent = ::send(sockfd_, buf, bytes, 0);
-            if (sent <= 0)
-            {
-                if (errno == EAGAIN || errno == EWOULDBLOCK)
-                {
-                    // 将未发送的数据重新放回BIO（重要！）
-                    BIO_write(writeBio_, buf + sent, bytes - sent);
-                    break;
-                }
-                throw std::runtime_error("Socket send failed");
-            }
+            base = static_cast<const char *>(iov[i + 1].iov_base);
+            avail = iov[i + 1].iov_len;
         }
     }
+    buf = coalesce_buf_.data();
+    return filled;
 }
 
-int SSLWrapper::write(const struct iovec *iov, int iovcnt)
+ssize_t SSLWrapper::writev(const struct iovec *iov, int iovcnt)
 {
-    ssize_t totalWritten = 0;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - last_write_ > std::chrono::milliseconds(RECORD_IDLE_RESET_MS))
+        boost_bytes_ = 0;
+    last_write_ = now;
 
-    for (int i = 0; i < iovcnt; ++i)
+    ssize_t total = 0;
+    while (true)
     {
-        const auto &vec = iov[i];
-        if (vec.iov_len == 0)
+        const char *buf;
+        int len;
+        if (retry_len_ > 0)
+        {
+            // 上次SSL_write没有完成，OpenSSL要求用同样的数据重试（调用者的iov从同一位置开始）
+            buf = retry_buf_;
+            len = retry_len_;
+        }
+        else
+        {
+            len = next_record(iov, iovcnt, total, buf);
+            if (len == 0)
+                break;
+        }
+
+        ERR_clear_error();
+        int written = SSL_write(ssl_, buf, len);
+        if (written > 0)
+        {
+            retry_len_ = 0;
+            total += written;
+            boost_bytes_ += written;
             continue;
+        }
 
-        // 将当前vec[i]数据写入缓冲区
-        int written = 0;
-        do
+        int err = SSL_get_error(ssl_, written);
+        if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
         {
-            written = SSL_write(ssl_,
-                                static_cast<char *>(vec.iov_base) + written,
-                                vec.iov_len - written);
+            retry_buf_ = buf;
+            retry_len_ = len;
+            if (total > 0)
+                return total;
+            errno = EAGAIN;
+            return -1;
+        }
+        print_detailed_ssl_errors(ssl_, written);
+        retry_len_ = 0;
+        errno = EPIPE;
+        return -1;
+    }
+    return total;
+}
 
-            if (written <= 0)
-            {
-                int err = SSL_get_error(ssl_, written);
-                if (err == SSL_ERROR_WANT_WRITE)
-                {
-                    // 确保所有加密数据已发送
-                    flushSslOut();
-                    continue;
-                }
-                throw_ssl_error("SSL write error");
-            }
+bool SSLWrapper::ktls_send() const
+{
+#ifdef SSL_OP_ENABLE_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#else
+    return false;
+#endif
+}
 
-            totalWritten += written;
-        } while (written < static_cast<int>(vec.iov_len));
+ssize_t SSLWrapper::sendfile(int fd, off_t &offset, size_t size)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+    ERR_clear_error();
+    ossl_ssize_t sent = SSL_sendfile(ssl_, fd, offset, size, 0);
+    if (sent > 0)
+    {
+        offset += sent;
+        return sent;
     }
-
-    // 确保所有加密数据已发送到网络
-    flushSslOut();
-    return totalWritten;
+    // 文件在发送过程中被截断
+    if (sent == 0)
+        return 0;
+    int err = SSL_get_error(ssl_, (int)sent);
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    print_detailed_ssl_errors(ssl_, (int)sent);
+    errno = EPIPE;
+    return -1;
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
 }
 
 void SSLWrapper::shutdown()
@@ -13,23 +13,43 @@
 #include <sys/fcntl.h>
 #include <cstring>
 #include <sys/uio.h>
+#include <vector>
+#include <chrono>
 
 class SSLWrapper
 {
 public:
+    // 握手推进一步之后的状态
+    enum HANDSHAKE_STATE
+    {
+        HANDSHAKE_DONE = 0,
+        HANDSHAKE_WANT_READ,  // 等待socket可读之后再继续
+        HANDSHAKE_WANT_WRITE, // 等待socket可写之后再继续
+        HANDSHAKE_FAILED
+    };
+
     SSLWrapper(int sockfd, SSL_CTX *ctx);
     ~SSLWrapper();
 
-    // 在SSL握手前检查连接是否仍然活跃
-    bool is_connection_alive(int sockfd);
+    // 非阻塞socket上推进一次服务端握手，由事件循环在socket就绪时反复调用
+    HANDSHAKE_STATE handshake();
 
     // SSL操作封装
+    // 阻塞socket上一次性完成握手（示例程序使用）
     bool accept();
+    // 返回-1且errno为EAGAIN表示暂时没有可读的数据
     int read(void *buf, size_t len);
-    void flushSslOut();
-    int write(const struct iovec *iov, int iovcnt);
+    // 把iov加密之后直接写到socket，返回值和writev一样：写入的明文字节数，
+    // 一个字节都没写进去时返回-1（errno为EAGAIN表示等待EPOLLOUT之后用剩余的数据再次调用）
+    ssize_t writev(const struct iovec *iov, int iovcnt);
     void shutdown();
 
+    // 握手之后内核是否接管了发送方向的记录加密（kTLS）
+    bool ktls_send() const;
+    // kTLS连接上把文件[offset, offset + size)交给内核加密发送，成功时推进offset；
+    // 返回值和sendfile一样，-1且errno为EAGAIN表示等待EPOLLOUT之后再次调用
+    ssize_t sendfile(int fd, off_t &offset, size_t size);
+
     void setCtx(SSL_CTX *ctx)
     {
         // 初始化SSL库，加载私钥和证书
@@ -68,7 +88,23 @@ private:
     SSL_CTX *ctx_;
     SSL *ssl_;
     int sockfd_;
-    BIO *writeBio_; // 用于存储待发送的加密数据
+
+    // 每次SSL_write的明文长度：TLS记录的上限是16KB；连接刚开始或者空闲之后
+    // 拥塞窗口较小，先用一个MSS能装下的小记录，客户端收到一个报文段就能解密
+    static const int TLS_MAX_RECORD = 16384;
+    static const int TLS_SMALL_RECORD = 1360;
+    static const size_t RECORD_BOOST_BYTES = 128 * 1024; // 发送这么多数据之后改用大记录
+    static const int RECORD_IDLE_RESET_MS = 1000;        // 空闲超过这个时间重新使用小记录
+
+    int record_size() const { return boost_bytes_ < RECORD_BOOST_BYTES ? TLS_SMALL_RECORD : TLS_MAX_RECORD; }
+    // 从iov中跳过skip字节之后取下一个记录的数据，当前这一段太小时和后面的段合并到coalesce_buf_
+    int next_record(const struct iovec *iov, int iovcnt, size_t skip, const char *&buf);
+
+    std::vector<char> coalesce_buf_;                // 合并小段用的缓冲区
+    const char *retry_buf_;                         // SSL_write返回WANT_WRITE时的数据，下次必须原样重试
+    int retry_len_;
+    size_t boost_bytes_;                            // 最近一次空闲之后发送的明文字节数
+    std::chrono::steady_clock::time_point last_write_;
 
     void throw_ssl_error(const std::string &msg) const;
 };
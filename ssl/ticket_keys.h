@@ -0,0 +1,153 @@
+#pragma once
+
+/*************************************************************
+*TLS会话票据（session ticket）密钥环
+*   - 票据用当前密钥加密，解密时接受最近KEY_COUNT个密钥中的任意一个
+*   - 当前密钥使用超过KEY_LIFETIME秒之后轮换，用旧密钥解密成功的票据
+*     会让OpenSSL重新签发一张新票据
+*   - 密钥只保存在进程内存中，重启之后旧票据失效，退化为完整握手
+**************************************************************/
+
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#include <mutex>
+#include <cstring>
+#include <ctime>
+
+class TicketKeyRing
+{
+public:
+    static const int KEY_COUNT = 3;        // 当前密钥 + 两个旧密钥
+    static const int KEY_LIFETIME = 3600;  // 每个密钥作为当前密钥的时间（秒）
+
+    static TicketKeyRing &instance()
+    {
+        static TicketKeyRing instance;
+        return instance;
+    }
+
+    TicketKeyRing(const TicketKeyRing &) = delete;
+    TicketKeyRing &operator=(const TicketKeyRing &) = delete;
+
+    // 为ctx注册票据密钥回调
+    void install(SSL_CTX *ctx)
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_cb);
+#else
+        SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticket_key_cb);
+#endif
+    }
+
+private:
+    struct ticket_key
+    {
+        unsigned char name[16];
+        unsigned char aes_key[32];
+        unsigned char hmac_key[32];
+        time_t created;
+        bool valid;
+    };
+
+    TicketKeyRing() : current_(0)
+    {
+        for (int i = 0; i < KEY_COUNT; ++i)
+            keys_[i].valid = false;
+        generate(keys_[current_], time(NULL));
+    }
+
+    static bool generate(ticket_key &key, time_t now)
+    {
+        key.valid = RAND_bytes(key.name, sizeof(key.name)) == 1 &&
+                    RAND_bytes(key.aes_key, sizeof(key.aes_key)) == 1 &&
+                    RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) == 1;
+        key.created = now;
+        return key.valid;
+    }
+
+    // 取当前密钥，过期时先轮换；调用者持有锁
+    ticket_key *current_key()
+    {
+        time_t now = time(NULL);
+        if (now - keys_[current_].created >= KEY_LIFETIME)
+        {
+            int next = (current_ + 1) % KEY_COUNT;
+            if (generate(keys_[next], now))
+                current_ = next;
+        }
+        return keys_[current_].valid ? &keys_[current_] : NULL;
+    }
+
+    // 按票据中的密钥名查找；is_current返回是否为当前密钥
+    ticket_key *find_key(const unsigned char *name, bool &is_current)
+    {
+        for (int i = 0; i < KEY_COUNT; ++i)
+        {
+            if (keys_[i].valid && memcmp(keys_[i].name, name, sizeof(keys_[i].name)) == 0)
+            {
+                is_current = i == current_;
+                return &keys_[i];
+            }
+        }
+        return NULL;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    typedef EVP_MAC_CTX mac_ctx;
+    static bool init_mac(mac_ctx *hctx, ticket_key *key)
+    {
+        OSSL_PARAM params[3];
+        params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key->hmac_key, sizeof(key->hmac_key));
+        params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0);
+        params[2] = OSSL_PARAM_construct_end();
+        return EVP_MAC_CTX_set_params(hctx, params) == 1;
+    }
+#else
+    typedef HMAC_CTX mac_ctx;
+    static bool init_mac(mac_ctx *hctx, ticket_key *key)
+    {
+        return HMAC_Init_ex(hctx, key->hmac_key, sizeof(key->hmac_key), EVP_sha256(), NULL) == 1;
+    }
+#endif
+
+    /*返回值：加密时1表示成功；解密时0表示不认识该票据（完整握手），
+      1表示解密成功，2表示解密成功但需要用当前密钥重新签发票据*/
+    static int ticket_key_cb(SSL *, unsigned char key_name[16], unsigned char *iv,
+                             EVP_CIPHER_CTX *cctx, mac_ctx *hctx, int enc)
+    {
+        TicketKeyRing &ring = instance();
+        std::lock_guard<std::mutex> lock(ring.mutex_);
+
+        if (enc)
+        {
+            ticket_key *key = ring.current_key();
+            if (!key || RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1)
+                return -1;
+            memcpy(key_name, key->name, sizeof(key->name));
+            if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv) != 1 ||
+                !init_mac(hctx, key))
+                return -1;
+            return 1;
+        }
+
+        bool is_current = false;
+        ticket_key *key = ring.find_key(key_name, is_current);
+        if (!key)
+            return 0;
+        if (!init_mac(hctx, key) ||
+            EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv) != 1)
+            return -1;
+        // 当前密钥已经轮换过，让客户端换一张新票据
+        return is_current && time(NULL) - key->created < KEY_LIFETIME ? 1 : 2;
+    }
+
+    std::mutex mutex_;
+    ticket_key keys_[KEY_COUNT];
+    int current_;
+};
@@ -0,0 +1,234 @@
+/*************************************************************
+*请求边界检查：向运行中的服务器发送长度有歧义的请求，检查服务器拒绝它们并关闭连接，
+*而不是把包体当成流水线中的下一个请求（请求走私）
+*   te          —— Transfer-Encoding: chunked，包体中藏一个GET，期望501
+*   te_space    —— "Transfer-Encoding :"（名称和冒号之间有空白），期望400
+*   cl_conflict —— 两个不同的Content-Length，期望400
+*   cl_repeat   —— 两个相同的Content-Length，期望400
+*   cl_invalid  —— Content-Length不是纯数字，期望400
+*   pipeline    —— 两个正常的流水线GET，期望两个200（对照）
+*每个用例只允许一个响应，之后连接必须被关闭
+*
+*   backpressure —— 客户端SO_RCVBUF很小并且先不读，流水线发送一个大文件（big_path）的GET、
+*                   PIPELINE_DEPTH个小文件（path）的GET和一个推理上传（PUT /10），
+*                   服务器写响应时会遇到EAGAIN；检查推理请求之前的每个响应都完整并且和单独请求得到的一致
+*                   回环接口的MSS很大，服务器的发送缓冲区会自动扩大到MB级，小响应那一批不一定遇到EAGAIN，
+*                   最好从另一台机器运行，big_path用一个几MB的文件
+*
+*   g++ -O2 -std=c++11 request_check.cpp -o request_check
+*   ./request_check 127.0.0.1 9006 /judge.html /frame.jpg
+**************************************************************/
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+struct check_case
+{
+    const char *name;
+    std::string request;
+    const char *status; // 期望的状态码
+    int responses;      // 期望的响应个数
+};
+
+// rcvbuf大于0时在connect之前设置SO_RCVBUF（TCP窗口在握手时确定）
+static int connect_to(const char *ip, int port, int rcvbuf = 0)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (rcvbuf > 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    // 服务器没有关闭连接时最多等2秒
+    timeval tv = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+// 读到对端关闭为止，closed返回是否真的被关闭（而不是超时）
+static std::string read_all(int fd, bool &closed)
+{
+    std::string out;
+    char buf[4096];
+    closed = false;
+    while (true)
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n == 0)
+        {
+            closed = true;
+            break;
+        }
+        if (n < 0)
+            break;
+        out.append(buf, n);
+    }
+    return out;
+}
+
+// 慢速读取：每次最多读chunk字节，读完之后停一会儿，让服务器的发送缓冲区一直是满的
+static std::string read_slowly(int fd, size_t chunk, int pause_us)
+{
+    std::string out;
+    char buf[4096];
+    while (true)
+    {
+        ssize_t n = recv(fd, buf, chunk < sizeof(buf) ? chunk : sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        out.append(buf, n);
+        usleep(pause_us);
+    }
+    return out;
+}
+
+static const int PIPELINE_DEPTH = 3; // 大响应之后的小响应个数，一起放得进服务器的写缓冲区
+
+// 从resp的pos处解析一个响应，返回状态码，body为包体；格式不对时返回空串
+static std::string next_response(const std::string &resp, size_t &pos, std::string &body)
+{
+    size_t head_end = resp.find("\r\n\r\n", pos);
+    if (resp.compare(pos, 9, "HTTP/1.1 ") != 0 || head_end == std::string::npos)
+        return "";
+    std::string status = resp.substr(pos + 9, 3);
+    size_t cl = resp.find("Content-Length:", pos);
+    if (cl == std::string::npos || cl > head_end)
+        return "";
+    size_t len = strtoul(resp.c_str() + cl + 15, NULL, 10);
+    if (head_end + 4 + len > resp.size())
+        return "";
+    body = resp.substr(head_end + 4, len);
+    pos = head_end + 4 + len;
+    return status;
+}
+
+// 单独请求一次path，返回包体；失败时返回false
+static bool fetch(const char *ip, int port, const std::string &path, std::string &body)
+{
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    int fd = connect_to(ip, port);
+    if (fd < 0)
+        return false;
+    send(fd, request.data(), request.size(), 0);
+    bool closed = false;
+    std::string out = read_all(fd, closed);
+    close(fd);
+    size_t pos = 0;
+    return next_response(out, pos, body) == "200";
+}
+
+/*第一个响应很大并且客户端先不读，它发完时服务器的发送缓冲区是满的，紧接着的一批小响应
+  （在推理请求之前停下）会遇到EAGAIN。写缓冲区中还有没发完的响应时服务器不能开始处理推理请求，
+  否则新响应会覆盖还没发出去的响应*/
+static bool check_backpressure(const char *ip, int port, const std::string &path, const std::string &big_path)
+{
+    std::string big, small;
+    if (!fetch(ip, port, big_path, big) || !fetch(ip, port, path, small))
+    {
+        printf("%-12s FAIL  cannot fetch %s or %s\n", "backpressure", big_path.c_str(), path.c_str());
+        return false;
+    }
+
+    int fd = connect_to(ip, port, 2048);
+    if (fd < 0)
+        return false;
+    std::string batch = "GET " + big_path + " HTTP/1.1\r\nHost: x\r\n\r\n";
+    for (int i = 0; i < PIPELINE_DEPTH; ++i)
+        batch += "GET " + path + " HTTP/1.1\r\nHost: x\r\n\r\n";
+    batch += "PUT /10 HTTP/1.1\r\nHost: x\r\nContent-Length: 4\r\nConnection: close\r\n\r\nabcd";
+    send(fd, batch.data(), batch.size(), 0);
+    // 先不读，然后慢慢读，让服务器的发送缓冲区写满
+    usleep(300 * 1000);
+    std::string out = read_slowly(fd, 2048, 100);
+    close(fd);
+
+    // 推理请求的响应和服务器是否加载了模型有关，只检查它前面的响应
+    int intact = 0;
+    size_t pos = 0;
+    for (int i = 0; i <= PIPELINE_DEPTH; ++i)
+    {
+        std::string body;
+        if (next_response(out, pos, body) != "200" || body != (i == 0 ? big : small))
+            break;
+        ++intact;
+    }
+    bool ok = intact == PIPELINE_DEPTH + 1;
+    printf("%-12s %s  intact=%d/%d\n", "backpressure", ok ? "ok  " : "FAIL", intact, PIPELINE_DEPTH + 1);
+    return ok;
+}
+
+static int count_responses(const std::string &out)
+{
+    int n = 0;
+    for (size_t pos = out.find("HTTP/1.1 "); pos != std::string::npos; pos = out.find("HTTP/1.1 ", pos + 1))
+        ++n;
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("usage: %s ip port [path] [big_path]\n", argv[0]);
+        return 2;
+    }
+    const char *ip = argv[1];
+    int port = atoi(argv[2]);
+    std::string path = argc > 3 ? argv[3] : "/judge.html";
+    std::string big_path = argc > 4 ? argv[4] : "/frame.jpg";
+    std::string get = "GET " + path + " HTTP/1.1\r\nHost: " + ip + "\r\n\r\n";
+    std::string smuggled = "GET /smuggled HTTP/1.1\r\nHost: x\r\n\r\n";
+
+    check_case cases[] = {
+        {"te", "POST " + path + " HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n" +
+                   "0\r\n\r\n" + smuggled, "501", 1},
+        {"te_space", "POST " + path + " HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\nTransfer-Encoding : chunked\r\n\r\n" +
+                         "0\r\n\r\n" + smuggled, "400", 1},
+        {"cl_conflict", "POST " + path + " HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\nContent-Length: 38\r\n\r\n" +
+                            smuggled, "400", 1},
+        {"cl_repeat", "POST " + path + " HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\nContent-Length: 0\r\n\r\n" +
+                          smuggled, "400", 1},
+        {"cl_invalid", "POST " + path + " HTTP/1.1\r\nHost: x\r\nContent-Length: 0x10\r\n\r\n" + smuggled, "400", 1},
+        {"pipeline", get + get.substr(0, get.size() - 2) + "Connection: close\r\n\r\n", "200", 2},
+    };
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        const check_case &c = cases[i];
+        int fd = connect_to(ip, port);
+        if (fd < 0)
+        {
+            printf("cannot connect to %s:%d\n", ip, port);
+            return 2;
+        }
+        send(fd, c.request.data(), c.request.size(), 0);
+        bool closed = false;
+        std::string out = read_all(fd, closed);
+        close(fd);
+
+        std::string status = out.size() >= 12 ? out.substr(9, 3) : "---";
+        int responses = count_responses(out);
+        bool ok = status == c.status && responses == c.responses && closed;
+        if (!ok)
+            ++failed;
+        printf("%-12s %s  status=%s responses=%d closed=%d\n", c.name, ok ? "ok  " : "FAIL", status.c_str(),
+               responses, closed);
+    }
+    if (!check_backpressure(ip, port, path, big_path))
+        ++failed;
+    return failed ? 1 : 0;
+}
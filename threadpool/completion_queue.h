@@ -0,0 +1,70 @@
+/*************************************************************
+*工作线程的完成队列：reactor模式下工作线程处理完读写任务后，
+*把对应的sockfd放入队列并写eventfd通知事件循环，事件循环在
+*epoll上感知到eventfd可读之后再统一取出处理，不再忙等工作线程
+**************************************************************/
+
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../lock/locker.h"
+
+class completion_queue
+{
+public:
+    completion_queue()
+    {
+        m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventfd < 0)
+        {
+            throw std::exception();
+        }
+    }
+
+    ~completion_queue()
+    {
+        close(m_eventfd);
+    }
+
+    // 注册到epoll上的fd
+    int get_fd() const
+    {
+        return m_eventfd;
+    }
+
+    // 工作线程调用：记录完成的连接并唤醒事件循环
+    void post(int sockfd)
+    {
+        m_mutex.lock();
+        m_done.push_back(sockfd);
+        m_mutex.unlock();
+
+        uint64_t one = 1;
+        ssize_t ret = write(m_eventfd, &one, sizeof(one));
+        (void)ret;
+    }
+
+    // 事件循环调用：一次性取出所有已完成的连接
+    void drain(std::vector<int> &done)
+    {
+        uint64_t count = 0;
+        ssize_t ret = read(m_eventfd, &count, sizeof(count));
+        (void)ret;
+
+        done.clear();
+        m_mutex.lock();
+        m_done.swap(done);
+        m_mutex.unlock();
+    }
+
+private:
+    int m_eventfd;
+    locker m_mutex;
+    std::vector<int> m_done;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/*************************************************************
+*有界无锁多生产者多消费者队列（Dmitry Vyukov bounded MPMC queue）
+*环形数组中每个槽位带一个序号，生产者/消费者只通过CAS竞争入队和
+*出队位置，不需要互斥锁，也不会像std::list那样为每个任务分配节点
+**************************************************************/
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include <exception>
+
+template <typename T>
+class mpmc_queue
+{
+public:
+    // 容量向上取整为2的幂，便于用位运算取模
+    explicit mpmc_queue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_buffer = new cell[size];
+        for (size_t i = 0; i < size; ++i)
+            m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+        m_enqueue_pos.store(0, std::memory_order_relaxed);
+        m_dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    ~mpmc_queue()
+    {
+        delete[] m_buffer;
+    }
+
+    // 队列已满返回false
+    bool enqueue(const T &data)
+    {
+        cell *c;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            c = &m_buffer[pos & m_mask];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            // 槽位空闲，尝试占用这个入队位置
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            // 槽位中的数据还没有被消费，队列满
+            else if (diff < 0)
+                return false;
+            // 其他生产者抢先了，重新读取入队位置
+            else
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+        c->data = data;
+        // 序号+1表示槽位中有数据，可以被消费
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列为空返回false
+    bool dequeue(T &data)
+    {
+        cell *c;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            c = &m_buffer[pos & m_mask];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+        data = c->data;
+        // 序号推进一圈，槽位留给下一轮的生产者
+        c->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // 当前元素个数的近似值（并发出入队时只能作为参考）
+    size_t size_approx() const
+    {
+        size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static const size_t CACHELINE_SIZE = 64;
+
+    // 入队和出队位置放在不同的缓存行，避免伪共享
+    char m_pad0[CACHELINE_SIZE];
+    cell *m_buffer;
+    size_t m_mask;
+    char m_pad1[CACHELINE_SIZE - sizeof(cell *) - sizeof(size_t)];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad2[CACHELINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dequeue_pos;
+    char m_pad3[CACHELINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    mpmc_queue(const mpmc_queue &);
+    mpmc_queue &operator=(const mpmc_queue &);
+};
+
+#endif
@@ -0,0 +1,206 @@
+/*************************************************************
+*线程池任务队列微基准测试：
+*   list   —— std::list + locker + sem（threadpool的QUEUE_LIST）
+*   mpmc   —— 有界无锁环形队列 + 先自旋再休眠（threadpool的QUEUE_LOCKFREE）
+*生产者和消费者线程数相同，从1增加到64，统计每秒处理的任务数
+*
+*   g++ -O2 -std=c++11 queue_bench.cpp -o queue_bench -lpthread
+*   ./queue_bench [每轮任务总数]
+**************************************************************/
+
+#include <list>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sched.h>
+#include <pthread.h>
+
+#include "../lock/locker.h"
+#include "mpmc_queue.h"
+
+static const int MAX_REQUESTS = 10000;
+static const int SPIN_COUNT = 128;
+
+// 与threadpool中QUEUE_LIST相同的实现
+class list_backend
+{
+public:
+    bool push(int *task)
+    {
+        m_lock.lock();
+        if (m_queue.size() >= (size_t)MAX_REQUESTS)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        m_queue.push_back(task);
+        m_lock.unlock();
+        m_stat.post();
+        return true;
+    }
+
+    int *take()
+    {
+        m_stat.wait();
+        m_lock.lock();
+        if (m_queue.empty())
+        {
+            m_lock.unlock();
+            return NULL;
+        }
+        int *task = m_queue.front();
+        m_queue.pop_front();
+        m_lock.unlock();
+        return task;
+    }
+
+private:
+    std::list<int *> m_queue;
+    locker m_lock;
+    sem m_stat;
+};
+
+// 与threadpool中QUEUE_LOCKFREE相同的实现
+class mpmc_backend
+{
+public:
+    mpmc_backend() : m_queue(MAX_REQUESTS), m_idle(0) {}
+
+    bool push(int *task)
+    {
+        if (!m_queue.enqueue(task))
+            return false;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_idle.load(std::memory_order_relaxed) > 0)
+            m_stat.post();
+        return true;
+    }
+
+    int *take()
+    {
+        int *task = NULL;
+        for (int i = 0; i < SPIN_COUNT; ++i)
+        {
+            if (m_queue.dequeue(task))
+                return task;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        sched_yield();
+        if (m_queue.dequeue(task))
+            return task;
+
+        m_idle.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_queue.dequeue(task))
+        {
+            task = NULL;
+            m_stat.wait();
+        }
+        m_idle.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+
+private:
+    mpmc_queue<int *> m_queue;
+    std::atomic<int> m_idle;
+    sem m_stat;
+};
+
+template <typename Backend>
+struct bench_ctx
+{
+    Backend queue;
+    long per_producer;
+    std::atomic<long> consumed;
+    long total;
+    int payload;
+};
+
+template <typename Backend>
+void *producer(void *arg)
+{
+    bench_ctx<Backend> *ctx = (bench_ctx<Backend> *)arg;
+    for (long i = 0; i < ctx->per_producer; ++i)
+    {
+        // 队列满时让出CPU后重试
+        while (!ctx->queue.push(&ctx->payload))
+            sched_yield();
+    }
+    return NULL;
+}
+
+template <typename Backend>
+void *consumer(void *arg)
+{
+    bench_ctx<Backend> *ctx = (bench_ctx<Backend> *)arg;
+    while (true)
+    {
+        int *task = ctx->queue.take();
+        if (!task)
+            continue;
+        // 哨兵任务表示结束
+        if (task != &ctx->payload)
+            break;
+        ctx->consumed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return NULL;
+}
+
+template <typename Backend>
+double run_bench(int threads, long total)
+{
+    bench_ctx<Backend> *ctx = new bench_ctx<Backend>();
+    ctx->per_producer = total / threads;
+    ctx->total = ctx->per_producer * threads;
+    ctx->consumed = 0;
+    ctx->payload = 0;
+
+    std::vector<pthread_t> producers(threads), consumers(threads);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&consumers[i], NULL, consumer<Backend>, ctx);
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&producers[i], NULL, producer<Backend>, ctx);
+    for (int i = 0; i < threads; ++i)
+        pthread_join(producers[i], NULL);
+
+    // 所有任务入队之后，每个消费者一个哨兵任务
+    int sentinel = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        while (!ctx->queue.push(&sentinel))
+            sched_yield();
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(consumers[i], NULL);
+    auto end = std::chrono::steady_clock::now();
+
+    if (ctx->consumed != ctx->total)
+        fprintf(stderr, "lost tasks: %ld / %ld\n", (long)ctx->consumed, ctx->total);
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double mops = ctx->total / seconds / 1e6;
+    delete ctx;
+    return mops;
+}
+
+int main(int argc, char *argv[])
+{
+    long total = argc > 1 ? atol(argv[1]) : 2000000;
+    const int thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+    printf("tasks per round: %ld (producers = consumers = threads)\n", total);
+    printf("%8s %16s %16s %10s\n", "threads", "list(Mops/s)", "mpmc(Mops/s)", "speedup");
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+    {
+        int threads = thread_counts[i];
+        double list_mops = run_bench<list_backend>(threads, total);
+        double mpmc_mops = run_bench<mpmc_backend>(threads, total);
+        printf("%8d %16.2f %16.2f %9.2fx\n", threads, list_mops, mpmc_mops, mpmc_mops / list_mops);
+    }
+    return 0;
+}
@@ -2,11 +2,23 @@
 #define THREADPOOL_H
 
 #include <list>
+#include <deque>
 #include <cstdio>
 #include <exception>
+#include <atomic>
+#include <sched.h>
 #include <pthread.h>
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "mpmc_queue.h"
+
+// 任务队列的实现方式
+enum QUEUE_MODEL
+{
+    QUEUE_LIST = 0,     // std::list + 互斥锁 + 信号量
+    QUEUE_LOCKFREE = 1, // 有界无锁环形队列 + 先自旋再休眠
+    QUEUE_STEALING = 2  // 每个工作线程一个双端队列，按fd分配，空闲线程窃取其他线程的任务
+};
 
 template <typename T> 
 class threadpool
@@ -17,16 +29,29 @@ public:
         int actor_model, 
         connection_pool *connPool, 
         int thread_number = 8, 
-        int max_request = 10000
+        int max_request = 10000,
+        int queue_model = QUEUE_LIST
     );
     ~threadpool();
-    bool append(T *request, int state);
-    bool append_p(T *request);
+    /*key用于在QUEUE_STEALING模式下选择工作线程（一般传入sockfd），同一连接的任务交给同一线程*/
+    bool append(T *request, int state, int key = -1);
+    bool append_p(T *request, int key = -1);
+    /*慢请求通道：is_inference_request()为真的请求转交给lane处理，lane队列已满时
+      直接调用reject_busy(retry_after)返回503，避免推理请求占满本线程池*/
+    void set_slow_lane(threadpool<T> *lane, int retry_after);
+    /*当前排队等待处理的任务数（近似值，用于负载判断）*/
+    int pending();
+    int thread_number() const { return m_thread_number; }
 
 private:
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void *worker(void *arg);
     void run();
+    bool push(T *request, int key);
+    bool enqueue(T *request, int key);
+    T *take(int id);
+    T *steal(int id);
+    bool offload(T *request);
 
 private:
     int m_thread_number;        //线程池中的线程数
@@ -37,15 +62,43 @@ private:
     sem m_queuestat;            //是否有任务需要处理（信号默认初始化资源为0）
     connection_pool *m_connPool;  //数据库
     int m_actor_model;          //模型切换
+
+    int m_queue_model;                  //任务队列实现方式
+    mpmc_queue<T *> *m_lockfree_queue;  //无锁队列（QUEUE_LOCKFREE）
+    std::atomic<int> m_idle;            //在信号量上休眠的线程数，没有休眠线程时入队不需要post
+    static const int SPIN_COUNT = 128;  //休眠之前自旋尝试出队的次数
+
+    // QUEUE_STEALING：每个工作线程私有的双端队列，自己从队头取，其他线程从队尾窃取
+    struct worker_deque
+    {
+        locker lock;
+        std::deque<T *> tasks;
+        sem stat;                  //投递到本队列的任务数（被窃取后可能虚假唤醒）
+        std::atomic<bool> busy;    //是否正在处理任务
+        worker_deque() : busy(false) {}
+    };
+    worker_deque *m_deques;
+    std::atomic<int> m_pending;       //所有双端队列中的任务总数，用于限制最大请求数
+    std::atomic<int> m_next_id;       //工作线程启动时领取自己的编号
+    std::atomic<unsigned> m_next_key; //没有指定key时轮询分配
+
+    threadpool<T> *m_slow_lane; //推理请求通道，为空表示不分流
+    int m_retry_after;          //推理通道饱和时Retry-After的秒数
 };
 template <typename T>
 threadpool<T>::threadpool( int actor_model, connection_pool *connPool, 
-    int thread_number, int max_requests) : m_actor_model(actor_model), 
+    int thread_number, int max_requests, int queue_model) : m_actor_model(actor_model), 
     m_thread_number(thread_number), m_max_requests(max_requests),
-    m_threads(NULL),m_connPool(connPool)
+    m_threads(NULL),m_connPool(connPool), m_queue_model(queue_model),
+    m_lockfree_queue(NULL), m_idle(0), m_deques(NULL), m_pending(0),
+    m_next_id(0), m_next_key(0), m_slow_lane(NULL), m_retry_after(1)
 {
     if (thread_number <= 0 || max_requests <= 0)
         throw std::exception();
+    if (QUEUE_LOCKFREE == m_queue_model)
+        m_lockfree_queue = new mpmc_queue<T *>(max_requests);
+    else if (QUEUE_STEALING == m_queue_model)
+        m_deques = new worker_deque[thread_number];
     // 保存线程ID的数组（C++中可以使用vector数组保存）
     m_threads = new pthread_t[m_thread_number];
     if (!m_threads)
@@ -66,28 +119,69 @@ template <typename T>
 threadpool<T>::~threadpool()
 {
     delete[] m_threads;
+    delete m_lockfree_queue;
+    delete[] m_deques;
 }
 template <typename T>
-bool threadpool<T>::append(T *request, int state)
+bool threadpool<T>::append(T *request, int state, int key)
 {
-    m_queuelocker.lock();
-    // 如果当前工作队列大于指定的最大请求数，直接返回
-    if (m_workqueue.size() >= m_max_requests)
+    // 标志当前请求状态并加入请求队列中(0-表示读，1-表示写)
+    request->m_state = state;
+    return push(request, key);
+}
+template <typename T>
+bool threadpool<T>::append_p(T *request, int key)
+{
+    return push(request, key);
+}
+// 任务在队列中和处理过程中持有连接的一次引用，连接在这期间关闭也不会被回收
+template <typename T>
+bool threadpool<T>::push(T *request, int key)
+{
+    request->retain();
+    if (!enqueue(request, key))
     {
-        m_queuelocker.unlock();
+        T::release(request);
         return false;
     }
-    // 标志当前请求状态并加入请求队列中(0-表示读，1-表示写)
-    request->m_state = state;
-    m_workqueue.push_back(request);
-
-    m_queuelocker.unlock();
-    m_queuestat.post();// 需要处理的任务数量减一
     return true;
 }
 template <typename T>
-bool threadpool<T>::append_p(T *request)
+bool threadpool<T>::enqueue(T *request, int key)
 {
+    if (QUEUE_STEALING == m_queue_model)
+    {
+        if (m_pending.fetch_add(1) >= m_max_requests)
+        {
+            m_pending.fetch_sub(1);
+            return false;
+        }
+        // 同一个fd总是交给同一个工作线程，连接的缓冲区可以留在该线程所在核的缓存中
+        unsigned slot = key >= 0 ? (unsigned)key : m_next_key.fetch_add(1, std::memory_order_relaxed);
+        int target = slot % m_thread_number;
+        worker_deque &q = m_deques[target];
+        q.lock.lock();
+        q.tasks.push_back(request);
+        q.lock.unlock();
+        q.stat.post();
+        // 目标线程正忙，再唤醒相邻线程过来窃取，避免任务一直排在忙碌线程后面
+        if (m_thread_number > 1 && q.busy.load(std::memory_order_relaxed))
+            m_deques[(target + 1) % m_thread_number].stat.post();
+        return true;
+    }
+
+    if (QUEUE_LOCKFREE == m_queue_model)
+    {
+        // 环形队列已满，直接返回
+        if (!m_lockfree_queue->enqueue(request))
+            return false;
+        // 和take()中的栅栏配对：要么工作线程能看到新任务，要么这里能看到休眠的工作线程
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_idle.load(std::memory_order_relaxed) > 0)
+            m_queuestat.post();
+        return true;
+    }
+
     // 保证线程安全
     m_queuelocker.lock();
     //根据硬件，预先设置请求队列的最大值
@@ -103,6 +197,126 @@ bool threadpool<T>::append_p(T *request)
     return true;
 }
 template <typename T>
+void threadpool<T>::set_slow_lane(threadpool<T> *lane, int retry_after)
+{
+    m_slow_lane = lane;
+    m_retry_after = retry_after;
+}
+template <typename T>
+int threadpool<T>::pending()
+{
+    if (QUEUE_STEALING == m_queue_model)
+        return m_pending.load(std::memory_order_relaxed);
+    if (QUEUE_LOCKFREE == m_queue_model)
+        return (int)m_lockfree_queue->size_approx();
+    m_queuelocker.lock();
+    int size = (int)m_workqueue.size();
+    m_queuelocker.unlock();
+    return size;
+}
+// 推理请求交给慢请求通道；返回true表示请求已被转交或已被拒绝，当前线程不再处理
+template <typename T>
+bool threadpool<T>::offload(T *request)
+{
+    if (!m_slow_lane || !request->is_inference_request())
+        return false;
+    if (!m_slow_lane->append_p(request))
+        request->reject_busy(m_retry_after);
+    return true;
+}
+// 从其他工作线程的队尾窃取一个任务
+template <typename T>
+T *threadpool<T>::steal(int id)
+{
+    for (int i = 1; i < m_thread_number; ++i)
+    {
+        worker_deque &victim = m_deques[(id + i) % m_thread_number];
+        victim.lock.lock();
+        if (!victim.tasks.empty())
+        {
+            T *request = victim.tasks.back();
+            victim.tasks.pop_back();
+            victim.lock.unlock();
+            return request;
+        }
+        victim.lock.unlock();
+    }
+    return NULL;
+}
+// 取出一个任务，没有任务时阻塞；返回NULL表示被唤醒但没有取到任务
+template <typename T>
+T *threadpool<T>::take(int id)
+{
+    T *request = NULL;
+    if (QUEUE_STEALING == m_queue_model)
+    {
+        worker_deque &own = m_deques[id];
+        while (true)
+        {
+            // 优先处理自己队列中的任务
+            own.lock.lock();
+            if (!own.tasks.empty())
+            {
+                request = own.tasks.front();
+                own.tasks.pop_front();
+            }
+            own.lock.unlock();
+            // 自己没有任务就去其他线程窃取
+            if (!request)
+                request = steal(id);
+            if (request)
+            {
+                m_pending.fetch_sub(1);
+                own.busy.store(true, std::memory_order_relaxed);
+                return request;
+            }
+            own.busy.store(false, std::memory_order_relaxed);
+            own.stat.wait();
+        }
+    }
+
+    if (QUEUE_LOCKFREE == m_queue_model)
+    {
+        // 先自旋一小段时间，任务密集时避免休眠/唤醒的系统调用
+        for (int i = 0; i < SPIN_COUNT; ++i)
+        {
+            if (m_lockfree_queue->dequeue(request))
+                return request;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        sched_yield();
+        if (m_lockfree_queue->dequeue(request))
+            return request;
+
+        // 登记为休眠线程之后再检查一次队列，防止错过push的唤醒
+        m_idle.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_lockfree_queue->dequeue(request))
+        {
+            request = NULL;
+            m_queuestat.wait();
+        }
+        m_idle.fetch_sub(1, std::memory_order_relaxed);
+        return request;
+    }
+
+    // 等待需要处理的任务，如果没有就阻塞，否则取出任务执行（使用信号量来记录需要处理的任务，大于0表示有多个任务需要处理）
+    m_queuestat.wait();
+    m_queuelocker.lock();
+    if (m_workqueue.empty())
+    {
+        m_queuelocker.unlock();
+        return NULL;
+    }
+    // 取出一个任务
+    request = m_workqueue.front();
+    m_workqueue.pop_front();
+    m_queuelocker.unlock();
+    return request;
+}
+template <typename T>
 void *threadpool<T>::worker(void *arg) // 静态成员函数，通过传参（this）来访问私有成员变量
 {
     threadpool *pool = (threadpool *)arg;
@@ -112,20 +326,12 @@ void *threadpool<T>::worker(void *arg) // 静态成员函数，通过传参（th
 template <typename T>
 void threadpool<T>::run()
 {
+    // 工作线程编号，QUEUE_STEALING模式下对应自己的双端队列
+    int id = m_next_id.fetch_add(1);
     while (true)
     {
-        // 等待需要处理的任务，如果没有就阻塞，否则取出任务执行（使用信号量来记录需要处理的任务，大于0表示有多个任务需要处理）
-        m_queuestat.wait();
-        m_queuelocker.lock();
-        if (m_workqueue.empty())
-        {
-            m_queuelocker.unlock();
-            continue;
-        }
-        // 取出一个任务
-        T *request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
+        // 取出一个任务（没有任务时阻塞）
+        T *request = take(id);
         if (!request)
             continue;
         // 如果当前是reactor模式
@@ -137,36 +343,49 @@ void threadpool<T>::run()
                 // 一次性读取所有数据（读取请求消息）
                 if (request->read_once())
                 {
-                    request->improv = 1;
-                    // 从数据库连接池中取出一个连接
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
-                    // 请求读还是请求写，解析完所有消息之后就是发送响应
-                    request->process();//process(模板类中的方法,这里是http类)进行处理
+                    if (!offload(request))
+                    {
+                        // 从数据库连接池中取出一个连接
+                        connectionRAII mysqlcon(&request->mysql, m_connPool);
+                        // 请求读还是请求写，解析完所有消息之后就是发送响应
+                        request->process();//process(模板类中的方法,这里是http类)进行处理
+                    }
                 }else{
-                    // 读取失败
-                    request->improv = 1;
-                    request->timer_flag = 1;// 读取失败后面就需要删除定时器（并将在epoll上监听的fd也删除和关闭连接）
+                    // 读取失败后面就需要删除定时器（并将在epoll上监听的fd也删除和关闭连接）
+                    request->timer_flag = 1;
                 }
             }else{
                 // 写数据是否成功（当然缓冲区写满之后，返回也是true）
-                if (request->write()) 
+                if (!request->write()) 
                 {
-                    request->improv = 1;
-                }else{
-                    // 写入失败
-                    request->improv = 1;
                     // 写入失败后面就需要删除定时器（并将在epoll上监听的fd也删除和关闭连接），不是一种优雅的关闭连接
                     request->timer_flag = 1;
                 }
+                // 流水线：读缓冲区中已经有下一个请求，socket上不会再有读事件，直接接着处理
+                else if (request->has_pending_request() && !offload(request))
+                {
+                    connectionRAII mysqlcon(&request->mysql, m_connPool);
+                    request->process();
+                }
             }
+            // 通过完成队列异步通知事件循环，事件循环不再等待工作线程
+            request->post_completion();
         }
         else
         {
             // 如果是proactor模式的话，在webserver那里就已经一次性读取出来或者写入了，因此这里直接取出一个连接，进行后面的处理即可
             // 不需要再进行读和写操作了 
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
-            request->process();
+            if (!offload(request))
+            {
+                connectionRAII mysqlcon(&request->mysql, m_connPool);
+                request->process();
+            }
+            // 处理失败时连接已经从epoll上移除，通知事件循环删除定时器并回收连接
+            if (request->timer_flag)
+                request->post_completion();
         }
+        // 转交给推理通道时那边已经持有自己的引用
+        T::release(request);
     }
 }
 #endif
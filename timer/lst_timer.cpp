@@ -2,9 +2,73 @@
 #include "../http/http_conn.h"
 
 
-void Utils::init(int timeslot)
+void Utils::init(int timeslot, int epollfd, int timer_model)
 {
     m_TIMESLOT = timeslot;
+    m_epollfd = epollfd;
+    m_timer_model = timer_model;
+
+    // 每个事件循环一个timerfd，到期时epoll上可读，不需要信号打断epoll_wait
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(m_timerfd >= 0);
+    addfd(m_epollfd, m_timerfd, false, 0);
+}
+
+void Utils::arm_timerfd(time_t expire)
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    // it_value全为0表示取消定时，已经过期的时间至少设置为1毫秒，让timerfd立刻触发
+    if (expire <= 0)
+        expire = 1;
+    spec.it_value.tv_sec = expire / 1000;
+    spec.it_value.tv_nsec = (expire % 1000) * 1000000;
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &spec, NULL);
+    m_armed = expire;
+}
+
+time_t Utils::next_expire()
+{
+    if (TIMER_WHEEL == m_timer_model)
+        return t_wheel.next_expire();
+    return t_min_heap.next_expire();
+}
+
+// 只有新的到期时间早于timerfd当前的设置时才需要重新设置，延后的定时器等timerfd触发之后再处理
+void Utils::add_timer(util_timer *timer)
+{
+    if (TIMER_WHEEL == m_timer_model)
+        t_wheel.add_timer(timer);
+    else
+        t_min_heap.add_timer(timer);
+    if (timer && m_timerfd >= 0 && (m_armed < 0 || timer->expire < m_armed))
+        arm_timerfd(timer->expire);
+}
+
+void Utils::adjust_timer(util_timer *timer, time_t new_expire)
+{
+    if (TIMER_WHEEL == m_timer_model)
+        t_wheel.adjust_timer(timer, new_expire);
+    else
+        t_min_heap.adjust_timer(timer, new_expire);
+    if (timer && m_timerfd >= 0 && (m_armed < 0 || new_expire < m_armed))
+        arm_timerfd(new_expire);
+}
+
+void Utils::del_timer(util_timer *timer)
+{
+    if (TIMER_WHEEL == m_timer_model)
+        t_wheel.del_timer(timer);
+    else
+        t_min_heap.del_timer(timer);
+}
+
+void Utils::tick()
+{
+    if (TIMER_WHEEL == m_timer_model)
+        t_wheel.tick();
+    else
+        t_min_heap.tick();
 }
 
 //对文件描述符设置非阻塞
@@ -77,18 +141,22 @@ void Utils::addsig(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-//定时处理任务，重新定时以不断触发SIGALRM信号
+//timerfd可读：处理到期的定时器，并把timerfd设置到下一个到期时间
 void Utils::timer_handler()
 {
+    // 读出到期次数，否则水平触发模式下timerfd会一直可读
+    uint64_t expirations = 0;
+    ssize_t ret = read(m_timerfd, &expirations, sizeof(expirations));
+    (void)ret;
+
     // 将那些已经超时的连接关闭 https://mp.weixin.qq.com/s/mmXLqh_NywhBXJvI45hchA
-    t_min_heap.tick();
-    /*
-       设置信号传送闹钟，即用来设置信号SIGALRM在经过参数seconds秒数后发送给目前的进程。
-       如果未设置信号SIGALRM的处理函数，那么alarm()默认处理终止进程.
-    */ 
-    // 利用alarm函数周期性地触发SIGALRM信号，信号处理函数利用管道通知主循环，主循环接收到该信
-    // 号后对升序链表上所有定时器进行处理，若该段时间内没有交换数据，则将该连接关闭，释放所占用的资源。
-    alarm(m_TIMESLOT);// 启动定时器
+    tick();
+
+    // 按最近的到期时间重新设置timerfd，没有定时器时不设置，等添加定时器时再设置
+    m_armed = -1;
+    time_t next = next_expire();
+    if (next >= 0)
+        arm_timerfd(next);
 }
 
 void Utils::show_error(int connfd, const char *info)
@@ -99,13 +167,22 @@ void Utils::show_error(int connfd, const char *info)
 }
 
 int *Utils::u_pipefd = 0;
-int Utils::u_epollfd = 0;
 
 class Utils;
 void cb_func(client_data *user_data)
 {
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
-    close(user_data->sockfd);
+    // 从连接所属的事件循环的epoll上删除
+    epoll_ctl(user_data->utils->m_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
+    // 定时器内嵌在client_data中，置空表示该连接已经关闭，重复关闭时直接跳过
+    user_data->timer = NULL;
     http_conn::m_user_count--;
+    // socket由recycle关闭：工作线程还在处理这个连接时，等它处理完再关闭，fd不会被新连接复用
+    if (user_data->conn)
+    {
+        http_conn::recycle(user_data->conn);
+        user_data->conn = NULL;
+    }
+    else
+        close(user_data->sockfd);
 }
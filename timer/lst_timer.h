@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/timerfd.h>
 
 #include <time.h>
 #include "../log/log.h"
@@ -28,10 +29,11 @@
 #include <queue>
 #include <vector>
 #include <functional> 
-#include <unordered_map>
 #include <algorithm>
 #include <mutex>
 
+#include "timing_wheel.h"
+
 /*
 非活跃：是指客户端（这里是浏览器）与服务器端建立连接后，长时间不交换数据，
     一直占用服务器端的文件描述符，导致连接资源的浪费。
@@ -43,35 +45,61 @@
     时事件统一管理。具体的，项目中使用升序链表将所有定时器串联组织起来。（现在是使用自定义的最小堆来记录定时器了）
 
 定时器超时时间 = 浏览器和服务器连接时刻 + 固定时间(TIMESLOT)，可以看出，
-定时器使用绝对时间作为超时值，这里alarm设置为5秒，连接超时为15秒。
+定时器使用绝对时间作为超时值，连接超时为15秒。
+超时时间使用CLOCK_MONOTONIC的毫秒数，每个事件循环一个timerfd，注册在自己的epoll上，
+并且总是设置在最近一个定时器到期的时刻，不再依赖alarm和SIGALRM周期性地轮询。
 */
 
 class util_timer;
-
-struct client_data {
-    sockaddr_in address;
-    int sockfd;
-    util_timer * timer;
-};
-
+class Utils;
+class http_conn;
+struct client_data;
 
 // 保持原有结构体定义不变
 class util_timer {
 public:
-    time_t expire;
+    util_timer() : expire(0), cb_func(NULL), user_data(NULL), heap_index(-1),
+                   wheel_prev(NULL), wheel_next(NULL), wheel_level(-1), wheel_slot(0) {}
+
+    // 单调时钟的当前毫秒数，不受系统时间调整影响
+    static time_t now_ms() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (time_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    time_t expire;      // 超时时间（毫秒）
     void (*cb_func)(client_data*);
     client_data* user_data;
+
+    // 在最小堆数组中的下标，-1表示不在堆中
+    int heap_index;
+
+    // 时间轮使用的侵入式链表节点
+    util_timer* wheel_prev;
+    util_timer* wheel_next;
+    int wheel_level;
+    int wheel_slot;
     
     bool operator>(const util_timer& other) const {
         return expire > other.expire; // 小顶堆
     }
 };
 
+// 定时器直接内嵌在预先分配的client_data数组中，建立和关闭连接时定时器路径上没有内存分配
+struct client_data {
+    sockaddr_in address;
+    int sockfd;
+    util_timer * timer;     // 指向timer_node表示定时器有效，NULL表示连接已经关闭
+    util_timer timer_node;
+    Utils * utils;      // 连接所属事件循环的工具类（epoll fd以及定时器最小堆）
+    http_conn * conn = NULL; // 连接建立时从slab中借用，关闭时还回去
+};
+
 class timer_min_heap {
 private:
     std::mutex mtx_;
-    std::vector<util_timer*> heap_;
-    std::unordered_map<util_timer*, size_t> timer_to_index_; // 指针到索引的映射
+    std::vector<util_timer*> heap_; // 下标记录在定时器自身的heap_index中
 
     // 上浮调整
     void sift_up(size_t index) {
@@ -82,8 +110,8 @@ private:
             // 否则交换父节点和子节点
             std::swap(heap_[index], heap_[parent]);
             // 对应的索引位置也需要发生改变
-            timer_to_index_[heap_[index]] = index;
-            timer_to_index_[heap_[parent]] = parent;
+            heap_[index]->heap_index = index;
+            heap_[parent]->heap_index = parent;
             // 继续向上调整
             index = parent;
         }
@@ -98,47 +126,52 @@ private:
             size_t right = 2 * index + 2;
             size_t smallest = index;
             
-            // 当前节点和左右孩子节点的时间大小做对比
-            if (left < size && *heap_[left] > *heap_[smallest]) 
+            // 当前节点和左右孩子节点的时间大小做对比，找出时间最小的节点
+            if (left < size && *heap_[smallest] > *heap_[left]) 
                 smallest = left;
-            if (right < size && *heap_[right] > *heap_[smallest]) 
+            if (right < size && *heap_[smallest] > *heap_[right]) 
                 smallest = right;
             // 说明左右孩子时间都大于当前父节点时间
             if (smallest == index) break;
 
             // 否则交换父子节点位置
             std::swap(heap_[index], heap_[smallest]);
-            timer_to_index_[heap_[index]] = index;
-            timer_to_index_[heap_[smallest]] = smallest;
+            heap_[index]->heap_index = index;
+            heap_[smallest]->heap_index = smallest;
             // 继续向下调整
             index = smallest;
         }
     }
 
 public:
+    // 预留数组空间，避免连接数增长时扩容
+    void reserve(size_t capacity) {
+        heap_.reserve(capacity);
+    }
+
     // 添加定时器
     void add_timer(util_timer* timer) {
         if (!timer) return;
         heap_.push_back(timer);
-        timer_to_index_[timer] = heap_.size() - 1;
+        timer->heap_index = heap_.size() - 1;
         // 添加定时器之后，需要对最小堆进行调整
         sift_up(heap_.size() - 1);
     }
 
     // 删除定时器
     void del_timer(util_timer* timer) {
-        if (!timer || !timer_to_index_.count(timer)) return;
+        if (!timer || timer->heap_index < 0) return;
         // 获得当前定时器对应的索引
-        size_t index = timer_to_index_[timer];
+        size_t index = timer->heap_index;
         // 取出数组的最后一个定时器（也就是最小堆对应的最后一个叶子节点）
         util_timer* last = heap_.back();
 
         // 用末尾元素替换待删除元素
         heap_[index] = last;
-        timer_to_index_[last] = index;
+        last->heap_index = index;
 
         // 移除末尾元素
-        timer_to_index_.erase(timer);
+        timer->heap_index = -1;
         heap_.pop_back();
 
         // 交换节点之后，需要调整堆
@@ -150,9 +183,9 @@ public:
 
     // 调整定时器时间
     void adjust_timer(util_timer* timer, time_t new_expire) {
-        if (!timer || !timer_to_index_.count(timer)) return;
+        if (!timer || timer->heap_index < 0) return;
 
-        size_t index = timer_to_index_[timer];
+        size_t index = timer->heap_index;
         time_t old_expire = timer->expire;
         timer->expire = new_expire;
 
@@ -177,8 +210,11 @@ public:
             信号事件与其他文件描述符都可以通过epoll来监测，从而实现统一处理。
     */
     void tick() {
+        tick(util_timer::now_ms());
+    }
+
+    void tick(time_t now) {
         std::lock_guard<std::mutex> lock(mtx_);
-        time_t now = time(nullptr);
         
         while (!heap_.empty() && heap_.front()->expire <= now) {
             util_timer* timer = heap_.front();
@@ -200,12 +236,12 @@ public:
         if (heap_.empty()) return;
         // 弹出堆顶的元素并删除
         util_timer* timer = heap_.front();
-        timer_to_index_.erase(timer);
+        timer->heap_index = -1;
 
         // 堆顶元素和最后叶子节点交换之后进行堆的调整，从而达到删除
         if (heap_.size() > 1) { 
             heap_[0] = heap_.back();
-            timer_to_index_[heap_[0]] = 0;
+            heap_[0]->heap_index = 0;
             heap_.pop_back();
             // 向下进行调整
             sift_down(0);
@@ -218,16 +254,44 @@ public:
     bool empty() const {
         return heap_.empty();
     }
+
+    // 最近一个定时器的到期时间，堆为空返回-1
+    time_t next_expire() const {
+        return heap_.empty() ? -1 : heap_.front()->expire;
+    }
+
+    size_t size() const {
+        return heap_.size();
+    }
+};
+
+// 定时器容器的实现方式
+enum TIMER_MODEL
+{
+    TIMER_HEAP = 0, // 最小堆，每次调整O(log n)，堆下标记录在定时器的heap_index中
+    TIMER_WHEEL = 1 // 分层时间轮，添加/删除/调整都是O(1)
 };
 
 
 class Utils
 {
     public:
-        Utils() {}
-        ~Utils() {}
+        Utils() : m_timer_model(TIMER_HEAP), m_timerfd(-1), m_armed(-1), m_epollfd(-1) {}
+        ~Utils()
+        {
+            if (m_timerfd >= 0)
+                close(m_timerfd);
+        }
+
+        void init(int timeslot, int epollfd, int timer_model = TIMER_HEAP);
 
-        void init(int timeslot);
+        // 按照m_timer_model转发给最小堆或时间轮
+        void add_timer(util_timer *timer);
+        void adjust_timer(util_timer *timer, time_t new_expire);
+        void del_timer(util_timer *timer);
+        void tick();
+        // 最近一个定时器的到期时间（毫秒），没有定时器返回-1
+        time_t next_expire();
 
         //对文件描述符设置非阻塞
         int setnonblocking(int fd);
@@ -241,17 +305,27 @@ class Utils
         //设置信号函数
         void addsig(int sig, void(handler)(int), bool restart = true);
 
-        //定时处理任务，重新定时以不断触发SIGALRM信号
+        //timerfd可读：处理到期的定时器，并把timerfd设置到下一个到期时间
         void timer_handler();
 
         void show_error(int connfd, const char *info);
 
+    private:
+        // 把timerfd设置为在expire（单调时钟毫秒数）到期
+        void arm_timerfd(time_t expire);
+
     public: 
         static int *u_pipefd;
         // 定时器双向链表 
         timer_min_heap t_min_heap;
-        // epoll的fd
-        static int u_epollfd;
+        // 分层时间轮
+        timing_wheel<util_timer> t_wheel;
+        int m_timer_model;
+        // 注册在m_epollfd上的timerfd，以及它当前被设置的到期时间（-1表示未设置）
+        int m_timerfd;
+        time_t m_armed;
+        // 所属事件循环的epoll fd（主反应堆和每个从反应堆各有一个）
+        int m_epollfd;
         int m_TIMESLOT;
 };
 
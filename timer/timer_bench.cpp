@@ -0,0 +1,99 @@
+/*************************************************************
+*定时器容器微基准测试：timer_min_heap 与 timing_wheel
+*模拟服务器上的定时器使用方式：
+*   add     —— 每个新连接添加一个3*TIMESLOT之后到期的定时器（毫秒）
+*   adjust  —— 每次读写事件把随机一个连接的定时器延后
+*   tick    —— 时间按毫秒推进，所有定时器依次到期并触发回调
+*定时器数量分别为10k、100k、1M，统计每个操作的平均耗时
+*
+*   g++ -O2 -std=c++11 timer_bench.cpp -o timer_bench -lpthread
+*   ./timer_bench
+**************************************************************/
+
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "lst_timer.h"
+
+static const int TIMESLOT_MS = 5000;
+static long g_fired = 0;
+
+static void bench_cb(client_data *)
+{
+    ++g_fired;
+}
+
+struct bench_result
+{
+    double add_ns;
+    double adjust_ns;
+    double tick_ns;
+};
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start, long ops)
+{
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / ops;
+}
+
+template <typename Container>
+bench_result run_bench(int count)
+{
+    bench_result result;
+    std::vector<util_timer> timers(count);
+    std::vector<client_data> users(count);
+    Container *container = new Container();
+    std::mt19937 rng(12345);
+    time_t now = util_timer::now_ms();
+
+    // 连接在一个TIMESLOT内陆续建立
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        timers[i].cb_func = bench_cb;
+        timers[i].user_data = &users[i];
+        timers[i].expire = now + 3 * TIMESLOT_MS + rng() % TIMESLOT_MS;
+        container->add_timer(&timers[i]);
+    }
+    result.add_ns = elapsed_ns(start, count);
+
+    // 每个连接平均有4次读写事件，每次都把定时器延后
+    long adjusts = (long)count * 4;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < adjusts; ++i)
+    {
+        util_timer *timer = &timers[rng() % count];
+        container->adjust_timer(timer, timer->expire + 1 + rng() % TIMESLOT_MS);
+    }
+    result.adjust_ns = elapsed_ns(start, adjusts);
+
+    // 时间不断推进直到所有定时器都到期
+    g_fired = 0;
+    start = std::chrono::steady_clock::now();
+    for (time_t t = now; !container->empty(); ++t)
+        container->tick(t);
+    result.tick_ns = elapsed_ns(start, count);
+    if (g_fired != count)
+        fprintf(stderr, "fired %ld / %d timers\n", g_fired, count);
+
+    delete container;
+    return result;
+}
+
+int main()
+{
+    const int counts[] = {10000, 100000, 1000000};
+
+    printf("%10s %8s %12s %12s %12s\n", "timers", "backend", "add(ns)", "adjust(ns)", "expire(ns)");
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+    {
+        bench_result heap = run_bench<timer_min_heap>(counts[i]);
+        bench_result wheel = run_bench<timing_wheel<util_timer> >(counts[i]);
+        printf("%10d %8s %12.1f %12.1f %12.1f\n", counts[i], "heap", heap.add_ns, heap.adjust_ns, heap.tick_ns);
+        printf("%10d %8s %12.1f %12.1f %12.1f\n", counts[i], "wheel", wheel.add_ns, wheel.adjust_ns, wheel.tick_ns);
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*************************************************************
+*分层时间轮（hierarchical timing wheel）
+*4层、每层64个槽，第0层一个槽代表一个时间单位，第n层一个槽代表64^n个单位，
+*总共覆盖64^4个单位，更远的定时器先放在最高层的最后一个槽里。
+*定时器节点是侵入式的双向链表节点，添加、删除、调整都是O(1)，
+*不需要额外分配内存，也不需要哈希表记录位置。
+*
+*Timer需要提供以下成员：
+*   expire                 绝对超时时间（与tick传入的now单位一致）
+*   static now_ms()        当前时间，时间轮第一次使用时以它为起点
+*   wheel_prev/wheel_next  槽内双向链表指针
+*   wheel_level            所在层，-1表示不在时间轮中
+*   wheel_slot             所在槽
+*   cb_func/user_data      超时回调
+*
+*时间轮不加锁，所有操作都必须在所属事件循环线程中进行
+**************************************************************/
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <time.h>
+#include <stddef.h>
+
+template <typename Timer>
+class timing_wheel
+{
+public:
+    timing_wheel() : current_(0), size_(0), started_(false)
+    {
+        for (int level = 0; level < WHEEL_LEVELS; ++level)
+            for (int slot = 0; slot < WHEEL_SIZE; ++slot)
+                slots_[level][slot] = NULL;
+    }
+
+    // 添加定时器
+    void add_timer(Timer *timer)
+    {
+        if (!timer)
+            return;
+        if (!started_)
+        {
+            // 第一次使用时以当前时间作为时间轮的起点
+            current_ = Timer::now_ms();
+            started_ = true;
+        }
+        place(timer);
+        ++size_;
+    }
+
+    // 删除定时器
+    void del_timer(Timer *timer)
+    {
+        if (!timer || timer->wheel_level < 0)
+            return;
+        unlink(timer);
+        --size_;
+    }
+
+    // 调整定时器时间：从原来的槽摘下，放到新的槽
+    void adjust_timer(Timer *timer, time_t new_expire)
+    {
+        if (!timer || timer->wheel_level < 0)
+            return;
+        unlink(timer);
+        timer->expire = new_expire;
+        place(timer);
+    }
+
+    void tick()
+    {
+        tick(Timer::now_ms());
+    }
+
+    // 推进时间轮直到now，触发所有到期的定时器
+    void tick(time_t now)
+    {
+        if (!started_)
+            return;
+        // 时间轮为空时直接跳到当前时间，避免长时间空闲之后逐格推进
+        if (0 == size_)
+        {
+            if (current_ <= now)
+                current_ = now + 1;
+            return;
+        }
+        while (current_ <= now)
+        {
+            int index = current_ & WHEEL_MASK;
+            // 第0层转完一圈，把上一层对应槽里的定时器重新分配到下面的层
+            if (0 == index)
+            {
+                for (int level = 1; level < WHEEL_LEVELS; ++level)
+                {
+                    if (cascade(level) != 0)
+                        break;
+                }
+            }
+
+            Timer *timer = slots_[0][index];
+            slots_[0][index] = NULL;
+            // 先推进时间，回调中重新添加的已过期定时器会落在下一个槽，而不是刚清空的这个槽
+            ++current_;
+            while (timer)
+            {
+                Timer *next = timer->wheel_next;
+                timer->wheel_prev = timer->wheel_next = NULL;
+                timer->wheel_level = -1;
+                --size_;
+                // 先从时间轮摘下再执行回调，回调中可以安全地重新添加定时器
+                if (timer->cb_func && timer->user_data)
+                    timer->cb_func(timer->user_data);
+                timer = next;
+            }
+        }
+    }
+
+    // 最近一个定时器到期时间的下界，时间轮为空返回-1
+    // 第0层的槽是精确时间；更高层的槽返回该槽开始的时间，届时会被下放到低层，
+    // 按这个时间唤醒最多只会提前醒来做一次下放，不会错过到期的定时器
+    time_t next_expire() const
+    {
+        if (0 == size_)
+            return -1;
+        // 第0层的定时器可能落在下一圈，而更高层的槽在那之前就要下放，所以每一层都要比较
+        time_t next = -1;
+        int base = current_ & WHEEL_MASK;
+        for (int i = 0; i < WHEEL_SIZE; ++i)
+        {
+            if (slots_[0][(base + i) & WHEEL_MASK])
+            {
+                next = current_ + i;
+                break;
+            }
+        }
+        for (int level = 1; level < WHEEL_LEVELS; ++level)
+        {
+            int shift = level * WHEEL_BITS;
+            int index = slot_index(current_, level);
+            // 本层当前这一圈的起点
+            time_t round = (current_ >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS);
+            // current_正好在本层槽的边界上时，当前槽还没有下放，下一次处理时就会下放
+            bool aligned = (current_ & (((time_t)1 << shift) - 1)) == 0;
+            for (int i = 0; i < WHEEL_SIZE; ++i)
+            {
+                int slot = (index + i) & WHEEL_MASK;
+                if (!slots_[level][slot])
+                    continue;
+                time_t start = round + ((time_t)slot << shift);
+                // 下标小于当前下标的槽（以及已经下放过的当前槽）属于下一圈
+                if (slot < index || (slot == index && !aligned))
+                    start += (time_t)1 << (shift + WHEEL_BITS);
+                if (next < 0 || start < next)
+                    next = start;
+            }
+        }
+        return next;
+    }
+
+    bool empty() const
+    {
+        return 0 == size_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    static const int WHEEL_BITS = 6;
+    static const int WHEEL_SIZE = 1 << WHEEL_BITS;
+    static const int WHEEL_MASK = WHEEL_SIZE - 1;
+    static const int WHEEL_LEVELS = 4;
+
+    // 第level层第n个槽所对应的下标
+    static int slot_index(time_t expire, int level)
+    {
+        return (expire >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    }
+
+    // 根据距离到期的时间选择所在层和槽
+    void place(Timer *timer)
+    {
+        time_t expire = timer->expire;
+        time_t delta = expire - current_;
+        int level = 0;
+        if (delta < 0)
+        {
+            // 已经过期的定时器放到下一次要处理的槽里
+            expire = current_;
+        }
+        else
+        {
+            while (level < WHEEL_LEVELS - 1 && delta >= ((time_t)1 << ((level + 1) * WHEEL_BITS)))
+                ++level;
+            // 超出时间轮范围的放在最高层能表示的最远位置，轮转到时再重新分配
+            time_t max_delta = ((time_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+            if (delta > max_delta)
+                expire = current_ + max_delta;
+        }
+        int slot = slot_index(expire, level);
+        Timer *&head = slots_[level][slot];
+        timer->wheel_level = level;
+        timer->wheel_slot = slot;
+        timer->wheel_prev = NULL;
+        timer->wheel_next = head;
+        if (head)
+            head->wheel_prev = timer;
+        head = timer;
+    }
+
+    // 从所在槽的链表中摘下
+    void unlink(Timer *timer)
+    {
+        if (timer->wheel_prev)
+            timer->wheel_prev->wheel_next = timer->wheel_next;
+        else
+            slots_[timer->wheel_level][timer->wheel_slot] = timer->wheel_next;
+        if (timer->wheel_next)
+            timer->wheel_next->wheel_prev = timer->wheel_prev;
+        timer->wheel_prev = timer->wheel_next = NULL;
+        timer->wheel_level = -1;
+    }
+
+    // 把第level层当前槽里的定时器重新放置，返回该层的槽下标
+    int cascade(int level)
+    {
+        int index = slot_index(current_, level);
+        Timer *timer = slots_[level][index];
+        slots_[level][index] = NULL;
+        while (timer)
+        {
+            Timer *next = timer->wheel_next;
+            place(timer);
+            timer = next;
+        }
+        return index;
+    }
+
+    Timer *slots_[WHEEL_LEVELS][WHEEL_SIZE];
+    time_t current_; // 下一个要处理的时间单位
+    size_t size_;
+    bool started_;
+};
+
+#endif
@@ -2,9 +2,6 @@
 
 WebServer::WebServer()
 {
-    // http_conn类对象
-    users = new http_conn[MAX_FD];
-
     // root文件夹路径
     char server_path[200];
     // 获得当前目录
@@ -15,8 +12,14 @@ WebServer::WebServer()
     // 当前目录拼接root目录
     strcat(m_root, root);
 
-    // 定时器
+    // 定时器以及连接对象的索引，连接对象本身在连接建立时才分配
     users_timer = new client_data[MAX_FD];
+
+    m_reactor_num = 0;
+    m_reactors = NULL;
+    m_pool = NULL;
+    m_infer_pool = NULL;
+    m_next_reactor = 0;
 }
 
 WebServer::~WebServer()
@@ -25,15 +28,26 @@ WebServer::~WebServer()
     close(m_listenfd);
     close(m_pipefd[1]);
     close(m_pipefd[0]);
-    delete[] users;
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        if (m_reactors[i].listenfd >= 0)
+            close(m_reactors[i].listenfd);
+        close(m_reactors[i].epollfd);
+        close(m_reactors[i].notify_pipe[0]);
+        close(m_reactors[i].notify_pipe[1]);
+    }
+    delete[] m_reactors;
     delete[] users_timer;
     delete m_pool;
+    delete m_infer_pool;
 }
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
                      int opt_linger, int trigmode, int sql_num, int thread_num, int close_log,
                      int actor_model, bool use_ssl, std::string cert_file, std::string private_file,
-                     bool is_compress)
+                     bool is_compress, int reactor_num, bool reuse_port, int backlog,
+                     int queue_model, int infer_thread_num, int infer_queue, int timer_model,
+                     int file_cache_mb, bool ktls)
 {
     m_port = port;
     m_user = user;
@@ -47,6 +61,17 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_close_log = close_log;
     m_actormodel = actor_model;
     is_compress_ = is_compress;
+    m_reactor_num = reactor_num > 0 ? reactor_num : 0;
+    m_reuse_port = reuse_port;
+    m_backlog = backlog > 0 ? backlog : SOMAXCONN;
+    m_queue_model = queue_model;
+    m_infer_thread_num = infer_thread_num > 0 ? infer_thread_num : 0;
+    m_infer_queue = infer_queue > 0 ? infer_queue : 1;
+    m_timer_model = timer_model;
+
+    // 静态文件缓存，0表示关闭
+    FileCache::instance().init(file_cache_mb > 0 ? (size_t)file_cache_mb * 1024 * 1024 : 0,
+                               FILE_CACHE_MAX_ENTRY);
 
     // 确保上传目录存在
     char upload_path[200];
@@ -54,6 +79,14 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     strcat(upload_path, "/uploads");
     mkdir(upload_path, 0755);
 
+    // 压缩结果缓存，并为站点目录下的静态文件预先生成压缩旁路文件
+    if (is_compress_)
+    {
+        CompressedCache::instance().init(COMPRESSED_CACHE_SIZE);
+        int sidecars = CompressedCache::instance().build_sidecars(m_root);
+        printf("precompressed %d static files\n", sidecars);
+    }
+
     use_ssl_ = use_ssl;
     if (use_ssl_)
     {
@@ -62,6 +95,11 @@ void WebServer::init(int port, string user, string passWord, string databaseName
         {
             opensslContext_ = std::make_shared<OpenSSLContext>(cert_file, private_file);
             printf("Initialize SSL/TLS is successfully!\n");
+            // kTLS不可用时连接照常走用户态加密
+            if (ktls && !opensslContext_->enable_ktls())
+                printf("kTLS is not supported by this OpenSSL, using userspace TLS\n");
+            else if (ktls)
+                printf("kTLS enabled\n");
         }
         catch (const std::exception &e)
         {
@@ -121,33 +159,50 @@ void WebServer::sql_pool()
                      m_databaseName, 3306, m_sql_num, m_close_log);
 
     // 初始化数据库读取表（从连接池中取出一个连接，并从数据库中读取对应表的内容，然后使用map<string,string>保存起来）
-    //  初始化用户表
-    users->initmysql_result(m_connPool);
+    //  初始化用户表（用户表保存在所有连接共享的map中，借一个连接对象执行查询）
+    http_conn *loader = http_conn::create();
+    loader->initmysql_result(m_connPool);
+    http_conn::recycle(loader);
 }
 
 void WebServer::thread_pool()
 {
     // 线程池
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num,
+                                       10000, m_queue_model);
+
+    // 推理请求单独一个有界线程池，避免少量图像上传占满所有工作线程而饿死静态文件请求
+    // 推理线程池总是按proactor方式处理：数据已经由通用线程池或事件循环读取完毕
+    if (m_infer_thread_num > 0)
+    {
+        m_infer_pool = new threadpool<http_conn>(0, m_connPool, m_infer_thread_num,
+                                                 m_infer_queue, QUEUE_LIST);
+        m_pool->set_slow_lane(m_infer_pool, INFER_RETRY_AFTER);
+    }
+
+    // 压缩级别参考通用线程池的排队深度
+    threadpool<http_conn> *pool = m_pool;
+    CompressionPolicy::instance().set_queue_probe([pool]() { return pool->pending(); },
+                                                  pool->thread_number());
 }
 
-// main eventloop
-void WebServer::eventListen()
+// 创建监听socket；reuse_port为true时多个socket可以绑定同一端口，由内核在它们之间分摊连接
+int WebServer::create_listenfd(bool reuse_port)
 {
     // 网络编程基础步骤
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(listenfd >= 0);
 
     // 优雅关闭连接
     if (0 == m_OPT_LINGER)
     {
         struct linger tmp = {0, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
     else if (1 == m_OPT_LINGER)
     {
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     int ret = 0;
@@ -159,82 +214,181 @@ void WebServer::eventListen()
 
     int flag = 1;
     // 设置listen fd的IP地址和端口可重用（应对timewait状态）
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-    ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    if (reuse_port)
+    {
+        ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        assert(ret >= 0);
+    }
+    ret = bind(listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);
-    ret = listen(m_listenfd, 5);
+    // 全连接队列长度，过小在突发连接时会丢弃SYN
+    ret = listen(listenfd, m_backlog);
     assert(ret >= 0);
+    return listenfd;
+}
 
-    // 时钟定时时间间隔设置
-    utils.init(TIMESLOT);
+// main eventloop
+void WebServer::eventListen()
+{
+    // SO_REUSEPORT + 从反应堆：每个从反应堆各自监听，主反应堆不再accept
+    if (m_reuse_port && m_reactor_num > 0)
+        m_listenfd = -1;
+    else
+        m_listenfd = create_listenfd(m_reuse_port);
 
     // epoll创建内核事件表
-    epoll_event events[MAX_EVENT_NUMBER];
     m_epollfd = epoll_create(5); // 5这个数字在这里没有意义
     assert(m_epollfd != -1);
+    // 时钟定时时间间隔设置，主反应堆的定时器绑定主epoll
+    utils.init(TIMESLOT, m_epollfd, m_timer_model);
+    // 最小堆按最大连接数预留空间，运行期间添加定时器不会扩容
+    if (TIMER_HEAP == m_timer_model && 0 == m_reactor_num)
+        utils.t_min_heap.reserve(MAX_FD);
     // 向epoll上面添加连接读事件并且会设置为非阻塞状态
-    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
-    // 注意这里赋值给http中的epoll_fd，也就是后面监听之后的accept对应fd回到http_conn.cpp中去进行初中到到epoll上
-    http_conn::m_epollfd = m_epollfd;
+    if (m_listenfd >= 0)
+        utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
 
     // 创建一对相互连接的Unix域套接字，用于进程间通信
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
+    int ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
     assert(ret != -1);
     // 设置管道写端非阻塞
     utils.setnonblocking(m_pipefd[1]);
     // 将管道读端注册到epoll上，以便于当写入信号到m_pipefd[1]就能感知到
     utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+    // reactor模式下工作线程通过eventfd通知事件循环任务已完成
+    utils.addfd(m_epollfd, m_cq.get_fd(), false, 0);
 
     // 添加忽略信号
     utils.addsig(SIGPIPE, SIG_IGN);
-    // 由alarm系统调用产生timer时钟信号，时间到了就处理信号函数；分别为超时和服务停止设置信号处理函数
-    utils.addsig(SIGALRM, utils.sig_handler, false);
+    // 定时器由每个事件循环的timerfd驱动，信号只剩服务停止
     // 终止信号，kill进程时触发这个信号（Ctrl + C会触发SIGINT信号）
     utils.addsig(SIGTERM, utils.sig_handler, false);
 
-    // 添加一个时钟（默认为5秒）每 TIMESLOT秒触发一次 SIGALRM信号，作为时间基准
-    // 时间到触发这个信号SIGALRM，那么就会执行信号处理函数sig_handler，那么就
-    // 会执行信号处理函数中的send函数发送给管道m_pipefd[1]，由于管道的 m_pipefd[0]
-    // 是注册在epoll上面的，因此 m_pipefd[0]就可以感知到并执行dealwithsignal函数中recv
-    // 接收到这个信号
-    alarm(TIMESLOT);
-
     // 工具类,信号和描述符基础操作
     Utils::u_pipefd = m_pipefd;
-    Utils::u_epollfd = m_epollfd;
+
+    // 启动从反应堆，之后主反应堆只负责accept和信号处理
+    if (m_reactor_num > 0)
+        start_sub_reactors();
 }
 
-void WebServer::timer(int connfd, struct sockaddr_in client_address)
+void WebServer::start_sub_reactors()
 {
-    if (fd_sslwrappers.find(connfd) != fd_sslwrappers.end())
+    m_reactors = new sub_reactor[m_reactor_num];
+    for (int i = 0; i < m_reactor_num; ++i)
     {
-        // 建立HTTP连接
-        users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode,
-                           m_close_log, m_user, m_passWord, m_databaseName,
-                           use_ssl_, opensslContext_, fd_sslwrappers[connfd],
-                           is_compress_);
+        sub_reactor *reactor = &m_reactors[i];
+        reactor->index = i;
+        reactor->server = this;
+        reactor->epollfd = epoll_create(5);
+        assert(reactor->epollfd != -1);
+        reactor->utils.init(TIMESLOT, reactor->epollfd, m_timer_model);
+        if (TIMER_HEAP == m_timer_model)
+            reactor->utils.t_min_heap.reserve(MAX_FD / m_reactor_num + 1);
+
+        // 主反应堆通过管道将新连接交给从反应堆，单条消息小于PIPE_BUF，写入是原子的
+        int ret = pipe(reactor->notify_pipe);
+        assert(ret != -1);
+        reactor->utils.addfd(reactor->epollfd, reactor->notify_pipe[0], false, 0);
+        reactor->utils.addfd(reactor->epollfd, reactor->cq.get_fd(), false, 0);
+
+        // 每个从反应堆一个SO_REUSEPORT监听socket，直接在本线程accept
+        reactor->listenfd = -1;
+        if (m_reuse_port)
+        {
+            reactor->listenfd = create_listenfd(true);
+            reactor->utils.addfd(reactor->epollfd, reactor->listenfd, false, m_LISTENTrigmode);
+        }
+
+        if (pthread_create(&reactor->thread, NULL, sub_reactor_worker, reactor) != 0)
+        {
+            LOG_ERROR("%s", "create sub reactor failure");
+            throw std::exception();
+        }
+        pthread_detach(reactor->thread);
     }
-    else
+}
+
+void *WebServer::sub_reactor_worker(void *arg)
+{
+    sub_reactor *reactor = (sub_reactor *)arg;
+    // 信号统一交给主反应堆处理，避免打断从反应堆的epoll_wait
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    reactor->server->subEventLoop(reactor);
+    return reactor;
+}
+
+// 轮询选择一个从反应堆，把新连接交给它
+void WebServer::dispatch_conn(int connfd, struct sockaddr_in client_address)
+{
+    sub_reactor *reactor = &m_reactors[m_next_reactor];
+    m_next_reactor = (m_next_reactor + 1) % m_reactor_num;
+
+    reactor_msg msg;
+    msg.connfd = connfd;
+    msg.address = client_address;
+    if (write(reactor->notify_pipe[1], &msg, sizeof(msg)) != sizeof(msg))
+    {
+        LOG_ERROR("dispatch fd %d to sub reactor %d failed", connfd, reactor->index);
+        close(connfd);
+    }
+}
+
+// 从反应堆读取主反应堆分发过来的新连接
+void WebServer::dealwithdispatch(sub_reactor *reactor)
+{
+    reactor_msg msg;
+    while (read(reactor->notify_pipe[0], &msg, sizeof(msg)) == sizeof(msg))
+        timer(msg.connfd, msg.address, reactor);
+}
+
+void WebServer::timer(int connfd, struct sockaddr_in client_address, sub_reactor *reactor)
+{
+    // 连接归属的事件循环：主反应堆或者某个从反应堆
+    Utils *owner = reactor ? &reactor->utils : &utils;
+
+    std::shared_ptr<SSLWrapper> ssl_wrapper;
+    m_ssl_lock.lock();
+    if (fd_sslwrappers.find(connfd) != fd_sslwrappers.end())
+        ssl_wrapper = fd_sslwrappers[connfd];
+    m_ssl_lock.unlock();
+
+    // 建立HTTP连接，连接对象从slab中借用，由cb_func在连接关闭时还回去
+    http_conn *conn = users_timer[connfd].conn;
+    if (!conn)
     {
-        // 建立HTTP连接
-        users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode,
-                           m_close_log, m_user, m_passWord, m_databaseName,
-                           use_ssl_, opensslContext_, nullptr, is_compress_);
+        conn = http_conn::create();
+        users_timer[connfd].conn = conn;
     }
+    conn->init(connfd, client_address, owner->m_epollfd, m_root, m_CONNTrigmode,
+                       m_close_log, m_user, m_passWord, m_databaseName,
+                       use_ssl_, opensslContext_, ssl_wrapper, is_compress_);
 
     // 初始化client_data数据
-    // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
+    // 使用client_data中内嵌的定时器，设置回调函数和超时时间，绑定用户数据，添加到定时器容器中
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;
+    // 定时器内嵌在client_data中，fd被复用时旧连接的定时器可能还在原事件循环的容器里，
+    // 先删掉再重新添加，否则同一个节点会被插入两次；节点不在容器中时del_timer直接返回
+    if (users_timer[connfd].utils)
+        users_timer[connfd].utils->del_timer(&users_timer[connfd].timer_node);
+    users_timer[connfd].utils = owner;
+    conn->m_cq = reactor ? &reactor->cq : &m_cq;
+    util_timer *timer = &users_timer[connfd].timer_node;
     timer->user_data = &users_timer[connfd];
     timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    // TLS连接先用较短的握手超时，握手完成之后再换成空闲超时，避免慢速客户端长期占用连接
+    timer->expire = util_timer::now_ms() + (use_ssl_ ? HANDSHAKE_TIMEOUT_MS : IDLE_TIMEOUT_MS);
     users_timer[connfd].timer = timer;
 
-    // 将当前定时器添加到链表中保存
-    utils.t_min_heap.add_timer(timer);
+    // 将当前定时器添加到所属事件循环的定时器容器中保存
+    owner->add_timer(timer);
 
     printf("%s %d add timer is finished!----------------->\n", __FILE__, __LINE__);
 }
@@ -243,10 +397,9 @@ void WebServer::timer(int connfd, struct sockaddr_in client_address)
 // 并对新的定时器在链表上的位置进行调整
 void WebServer::adjust_timer(util_timer *timer)
 {
-    time_t cur = time(NULL);
     if (timer && timer->cb_func && timer->user_data->timer)
     {
-        utils.t_min_heap.adjust_timer(timer, cur + 3 * TIMESLOT);
+        timer->user_data->utils->adjust_timer(timer, util_timer::now_ms() + IDLE_TIMEOUT_MS);
     }
 
     LOG_INFO("%s", "adjust timer once");
@@ -254,98 +407,102 @@ void WebServer::adjust_timer(util_timer *timer)
 
 void WebServer::deal_timer(util_timer *timer, int sockfd)
 {
+    // 连接已经被超时处理关闭过了
+    if (!timer)
+        return;
     // 从epoll上删除对应的fd
     timer->cb_func(&users_timer[sockfd]);
+    m_ssl_lock.lock();
     if (fd_sslwrappers.find(sockfd) != fd_sslwrappers.end())
     {
         fd_sslwrappers.erase(sockfd);
     }
-    if (timer)
+    m_ssl_lock.unlock();
+    // 并将已经执行之后的定时器从所属事件循环的定时器容器中删除
+    users_timer[sockfd].utils->del_timer(timer);
+
+    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+}
+
+// 处理accept得到的新连接：建立SSL/TLS，然后交给对应的事件循环
+bool WebServer::dealnewconn(int connfd, struct sockaddr_in client_address, sub_reactor *reactor)
+{
+    // 当HTTP连接的数量大于指定数量就直接返回
+    if (http_conn::m_user_count >= MAX_FD)
     {
-        // 并将已经执行之后的定时器从链表中删除
-        utils.t_min_heap.del_timer(timer);
+        utils.show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return false;
     }
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+    if (use_ssl_)
+    {
+        // 这里只创建SSL对象，握手由连接所属的事件循环在socket就绪时推进，不阻塞accept
+        std::shared_ptr<SSLWrapper> ssl_wrapper;
+        try
+        {
+            ssl_wrapper = std::make_shared<SSLWrapper>(connfd, opensslContext_->get());
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("%s %d SSL/TLS init failed: %s", __FILE__, __LINE__, e.what());
+            close(connfd);
+            return true;
+        }
+        m_ssl_lock.lock();
+        fd_sslwrappers[connfd] = ssl_wrapper;
+        m_ssl_lock.unlock();
+    }
+
+    // SO_REUSEPORT模式下由accept的从反应堆自己管理；否则由主反应堆分发或者自己管理
+    if (reactor)
+        timer(connfd, client_address, reactor);
+    else if (m_reactor_num > 0)
+        dispatch_conn(connfd, client_address);
+    else
+        timer(connfd, client_address);
+    return true;
 }
 
-bool WebServer::dealclientdata()
+bool WebServer::dealclientdata(sub_reactor *reactor)
 {
     struct sockaddr_in client_address;
     socklen_t client_addrlength = sizeof(client_address);
+    int listenfd = reactor ? reactor->listenfd : m_listenfd;
+    // 新连接直接由accept4设置为非阻塞，省去后续fcntl调用；TLS握手也在非阻塞socket上进行
+    int accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
     // 默认水平触发模式
     if (0 == m_LISTENTrigmode)
     {
         // 和客户端建立连接
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+        int connfd = accept4(listenfd, (struct sockaddr *)&client_address, &client_addrlength, accept_flags);
         if (connfd < 0)
         {
             LOG_ERROR("%s:errno is:%d", "accept error", errno);
             return false;
         }
-        if (http_conn::m_user_count >= MAX_FD)
-        {
-            utils.show_error(connfd, "Internal server busy");
-            LOG_ERROR("%s", "Internal server busy");
-            return false;
-        }
-
-        if (use_ssl_)
-        {
-            std::shared_ptr<SSLWrapper> ssl_wrapper = std::make_unique<SSLWrapper>(connfd, opensslContext_->get());
-            // 设置SSL模式为非阻塞
-            SSL_set_mode(ssl_wrapper->getSSL(), SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
-            // 如果ssl没有建立成功就直接退出
-            if (ssl_wrapper->accept() <= 0)
-            {
-                LOG_ERROR("%s %d SSL/TLS connect failed!", __FILE__, __LINE__);
-                printf("%s %d SSL/TLS connect failed!\n", __FILE__, __LINE__);
-                return false;
-            }
-            fd_sslwrappers[connfd] = ssl_wrapper;
-        }
-        timer(connfd, client_address);
+        return dealnewconn(connfd, client_address, reactor);
     }
     else
     {
         // 如果是边缘触发模式，就要保证这次的把所有的连接读取完
         while (1)
         {
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+            int connfd = accept4(listenfd, (struct sockaddr *)&client_address, &client_addrlength, accept_flags);
             if (connfd < 0)
             {
                 LOG_ERROR("%s:errno is:%d", "accept error", errno);
                 break;
             }
-            // 当HTTP连接的数量大于指定数量就直接返回
-            if (http_conn::m_user_count >= MAX_FD)
-            {
-                utils.show_error(connfd, "Internal server busy");
-                LOG_ERROR("%s", "Internal server busy");
+            if (!dealnewconn(connfd, client_address, reactor))
                 break;
-            }
-            if (use_ssl_)
-            {
-                std::shared_ptr<SSLWrapper> ssl_wrapper = std::make_unique<SSLWrapper>(connfd, opensslContext_->get());
-                // 设置SSL模式为非阻塞
-                SSL_set_mode(ssl_wrapper->getSSL(), SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
-                // 如果ssl没有建立成功就直接退出
-                if (ssl_wrapper->accept() <= 0)
-                {
-                    LOG_ERROR("%s %d SSL/TLS connect failed!", __FILE__, __LINE__);
-                    printf("%s %d SSL/TLS connect failed!\n", __FILE__, __LINE__);
-                    return false;
-                }
-                fd_sslwrappers[connfd] = ssl_wrapper;
-            }
-            timer(connfd, client_address);
         }
         return false;
     }
     return true;
 }
 
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
+bool WebServer::dealwithsignal(bool &stop_server)
 {
     int ret = 0;
     int sig;
@@ -368,11 +525,6 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
         {
             switch (signals[i])
             {
-            case SIGALRM:
-            {
-                timeout = true;
-                break;
-            }
             case SIGTERM:
             {
                 stop_server = true;
@@ -384,8 +536,37 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
     return true;
 }
 
+// TLS握手状态机：每次socket就绪推进一步，握手期间的读写事件不交给线程池
+void WebServer::dealwithhandshake(int sockfd)
+{
+    http_conn *conn = users_timer[sockfd].conn;
+    util_timer *timer = users_timer[sockfd].timer;
+    if (!conn)
+        return;
+    if (!conn->do_handshake())
+    {
+        deal_timer(timer, sockfd);
+        return;
+    }
+    // 握手完成之后换成正常的空闲超时
+    if (conn->handshake_done() && timer)
+        adjust_timer(timer);
+}
+
 void WebServer::dealwithread(int sockfd)
 {
+    // 同一批事件中前面的事件已经关闭了这个连接
+    http_conn *conn = users_timer[sockfd].conn;
+    if (!conn)
+        return;
+
+    // TLS握手还没有完成
+    if (!conn->handshake_done())
+    {
+        dealwithhandshake(sockfd);
+        return;
+    }
+
     // 获得一个定时器任务
     util_timer *timer = users_timer[sockfd].timer;
 
@@ -398,34 +579,22 @@ void WebServer::dealwithread(int sockfd)
             adjust_timer(timer);
         }
 
-        // 若监测到读事件，将该事件放入请求队列
-        m_pool->append(users + sockfd, 0);
-
-        while (true)
+        // 若监测到读事件，将该事件放入请求队列；工作线程完成后通过完成队列通知，这里不再等待
+        if (!m_pool->append(conn, 0, sockfd))
         {
-            // 判断当前是否进行了提升
-            if (1 == users[sockfd].improv)
-            {
-                // 表示执行失败，将对应的fd 从epoll上删除以及关闭对应连接
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
+            LOG_ERROR("%s", "request queue is full");
+            deal_timer(timer, sockfd);
         }
     }
     else
     {
         // proactor
-        if (users[sockfd].read_once()) // 一次性读取成功
+        if (conn->read_once()) // 一次性读取成功
         {
-            LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            LOG_INFO("deal with the client(%s)", inet_ntoa(conn->get_address()->sin_addr));
 
-            // 若监测到读事件，将该事件放入请求队列，注意users是一个指针类型，users + sockfd表示指向了sockfd的位置http_conn
-            m_pool->append_p(users + sockfd);
+            // 若监测到读事件，将该事件放入请求队列
+            m_pool->append_p(conn, sockfd);
 
             // 重置定时器时间
             if (timer)
@@ -443,6 +612,17 @@ void WebServer::dealwithread(int sockfd)
 
 void WebServer::dealwithwrite(int sockfd)
 {
+    http_conn *conn = users_timer[sockfd].conn;
+    if (!conn)
+        return;
+
+    // TLS握手还没有完成
+    if (!conn->handshake_done())
+    {
+        dealwithhandshake(sockfd);
+        return;
+    }
+
     util_timer *timer = users_timer[sockfd].timer;
     // reactor
     if (1 == m_actormodel)
@@ -453,29 +633,22 @@ void WebServer::dealwithwrite(int sockfd)
             adjust_timer(timer);
         }
 
-        m_pool->append(users + sockfd, 1);
-
-        while (true)
+        if (!m_pool->append(conn, 1, sockfd))
         {
-            if (1 == users[sockfd].improv)
-            {
-                // 执行写失败就删除对应的定时器
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
+            LOG_ERROR("%s", "request queue is full");
+            deal_timer(timer, sockfd);
         }
     }
     else
     {
         // proactor
-        if (users[sockfd].write())
+        if (conn->write())
         {
-            LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            LOG_INFO("send data to the client(%s)", inet_ntoa(conn->get_address()->sin_addr));
+
+            // 流水线：读缓冲区中已经有下一个请求，交给线程池接着处理
+            if (conn->has_pending_request())
+                m_pool->append_p(conn, sockfd);
 
             // 重置定时器时间
             if (timer)
@@ -489,10 +662,28 @@ void WebServer::dealwithwrite(int sockfd)
         }
     }
 }
+// 处理工作线程完成的任务：读写失败的连接在这里删除定时器并关闭
+void WebServer::dealwithcompletion(completion_queue *cq)
+{
+    std::vector<int> done;
+    cq->drain(done);
+    for (size_t i = 0; i < done.size(); ++i)
+    {
+        int sockfd = done[i];
+        // 连接可能已经被超时处理关闭，对象已经还回slab
+        http_conn *conn = users_timer[sockfd].conn;
+        if (conn && 1 == conn->timer_flag)
+        {
+            // deal_timer会回收连接对象，先清除标志
+            conn->timer_flag = 0;
+            deal_timer(users_timer[sockfd].timer, sockfd);
+        }
+    }
+}
+
 // sub_eventloop
 void WebServer::eventLoop()
 {
-    bool timeout = false;
     bool stop_server = false;
 
     while (!stop_server)
@@ -525,11 +716,21 @@ void WebServer::eventLoop()
             // 处理信号，并且发生的是读事件
             else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN))
             {
-                // 接受进程发送的信号，判断是超时信号还是服务停止信号
-                bool flag = dealwithsignal(timeout, stop_server);
+                // 接受进程发送的信号（服务停止信号）
+                bool flag = dealwithsignal(stop_server);
                 if (false == flag)
                     LOG_ERROR("%s", "dealclientdata failure");
             }
+            // timerfd到期，处理超时的连接
+            else if (sockfd == utils.m_timerfd)
+            {
+                utils.timer_handler();
+            }
+            // reactor模式下工作线程完成了读写任务
+            else if (sockfd == m_cq.get_fd())
+            {
+                dealwithcompletion(&m_cq);
+            }
             // 处理客户连接上接收到的数据
             else if (events[i].events & EPOLLIN)
             {
@@ -541,14 +742,57 @@ void WebServer::eventLoop()
                 dealwithwrite(sockfd);
             }
         }
-        if (timeout)
+    }
+}
+
+// 从反应堆的事件循环：处理分发过来的连接上的读写事件
+void WebServer::subEventLoop(sub_reactor *reactor)
+{
+    while (true)
+    {
+        int number = epoll_wait(reactor->epollfd, reactor->events, MAX_EVENT_NUMBER, -1);
+        if (number < 0 && errno != EINTR)
         {
-            // 如果是超时信号，就把那些定时器过时的都从最小堆中删除
-            utils.timer_handler();
+            LOG_ERROR("sub reactor %d epoll failure", reactor->index);
+            break;
+        }
 
-            LOG_INFO("%s", "timer tick");
+        for (int i = 0; i < number; i++)
+        {
+            int sockfd = reactor->events[i].data.fd;
 
-            timeout = false;
+            // SO_REUSEPORT模式下本线程自己accept
+            if (sockfd == reactor->listenfd)
+            {
+                dealclientdata(reactor);
+            }
+            // 主反应堆分发的新连接
+            else if (sockfd == reactor->notify_pipe[0])
+            {
+                if (reactor->events[i].events & EPOLLIN)
+                    dealwithdispatch(reactor);
+            }
+            else if (sockfd == reactor->cq.get_fd())
+            {
+                dealwithcompletion(&reactor->cq);
+            }
+            else if (sockfd == reactor->utils.m_timerfd)
+            {
+                reactor->utils.timer_handler();
+            }
+            else if (reactor->events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                util_timer *timer = users_timer[sockfd].timer;
+                deal_timer(timer, sockfd);
+            }
+            else if (reactor->events[i].events & EPOLLIN)
+            {
+                dealwithread(sockfd);
+            }
+            else if (reactor->events[i].events & EPOLLOUT)
+            {
+                dealwithwrite(sockfd);
+            }
         }
     }
 }
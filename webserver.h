@@ -13,13 +13,44 @@
 #include <sys/epoll.h>
 
 #include "./threadpool/threadpool.h"
+#include "./threadpool/completion_queue.h"
 #include "./http/http_conn.h"
 #include "./ssl/ssl_context.h"
 #include "./ssl/ssl_wrapper.h"
+#include "./cache/file_cache.h"
 
 const int MAX_FD = 65536;           // 最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; // 最大事件数
-const int TIMESLOT = 5;             // 最小超时单位
+const int TIMESLOT = 5;             // 最小超时单位（秒）
+const time_t IDLE_TIMEOUT_MS = 3 * TIMESLOT * 1000; // 非活跃连接超时时间（毫秒）
+const time_t HANDSHAKE_TIMEOUT_MS = TIMESLOT * 1000; // TLS握手必须在这个时间内完成（毫秒）
+const size_t FILE_CACHE_MAX_ENTRY = 1024 * 1024; // 超过1MB的文件不进入文件缓存
+const size_t COMPRESSED_CACHE_SIZE = 32 * 1024 * 1024; // 压缩结果缓存的总大小
+const int INFER_RETRY_AFTER = 1;    // 推理通道饱和时建议客户端重试的间隔（秒）
+
+class WebServer;
+
+// 从反应堆：每个线程拥有独立的epoll fd、定时器（带自己的timerfd）以及事件数组，
+// 主反应堆只负责accept和信号，新连接通过通知管道轮询分发给从反应堆
+struct sub_reactor
+{
+    int index;
+    int epollfd;
+    int listenfd;       // SO_REUSEPORT模式下独立的监听socket，否则为-1
+    int notify_pipe[2]; // 主反应堆写入reactor_msg，从反应堆读取
+    pthread_t thread;
+    Utils utils; // 该事件循环独立的定时器
+    completion_queue cq; // reactor模式下工作线程完成通知
+    epoll_event events[MAX_EVENT_NUMBER];
+    WebServer *server;
+};
+
+// 主反应堆发送给从反应堆的消息
+struct reactor_msg
+{
+    int connfd; // 新连接
+    sockaddr_in address;
+};
 
 class WebServer
 {
@@ -31,7 +62,9 @@ public:
               int log_write, int opt_linger, int trigmode, int sql_num,
               int thread_num, int close_log, int actor_model,
               bool use_ssl, std::string cert_file, std::string private_file,
-              bool is_compress);
+              bool is_compress, int reactor_num, bool reuse_port, int backlog,
+              int queue_model, int infer_thread_num, int infer_queue, int timer_model,
+              int file_cache_mb, bool ktls);
 
     // 创建线程池
     void thread_pool();
@@ -40,15 +73,26 @@ public:
     void trig_mode();   // 触发模式
     void eventListen(); // 连接事件
     void eventLoop();   // 事件循环
-    // 定时器
-    void timer(int connfd, struct sockaddr_in client_address);
+    // 定时器（reactor为空表示由主反应堆管理该连接）
+    void timer(int connfd, struct sockaddr_in client_address, sub_reactor *reactor = NULL);
     // 调整定时器
     void adjust_timer(util_timer *timer);
     void deal_timer(util_timer *timer, int sockfd);
-    bool dealclientdata();
-    bool dealwithsignal(bool &timeout, bool &stop_server);
+    int create_listenfd(bool reuse_port);
+    bool dealclientdata(sub_reactor *reactor = NULL);
+    bool dealnewconn(int connfd, struct sockaddr_in client_address, sub_reactor *reactor);
+    bool dealwithsignal(bool &stop_server);
     void dealwithread(int sockfd);
     void dealwithwrite(int sockfd);
+    void dealwithhandshake(int sockfd);
+    void dealwithcompletion(completion_queue *cq);
+
+    // 多反应堆（main reactor + sub reactor）
+    void start_sub_reactors();
+    static void *sub_reactor_worker(void *arg);
+    void subEventLoop(sub_reactor *reactor);
+    void dispatch_conn(int connfd, struct sockaddr_in client_address);
+    void dealwithdispatch(sub_reactor *reactor);
 
 public:
     // 基础
@@ -60,7 +104,6 @@ public:
 
     int m_pipefd[2];
     int m_epollfd; // IO多路复用fd
-    http_conn *users;
 
     // 数据库相关
     connection_pool *m_connPool;
@@ -72,19 +115,28 @@ public:
     // 线程池相关
     threadpool<http_conn> *m_pool;
     int m_thread_num; // 线程池中线程数量
+    int m_queue_model; // 线程池任务队列实现方式
+    completion_queue m_cq; // 主反应堆的完成队列
+    // 推理请求独立线程池：线程数即并发上限，队列长度即排队上限，0个线程表示不分流
+    threadpool<http_conn> *m_infer_pool;
+    int m_infer_thread_num;
+    int m_infer_queue;
 
     // epoll_event相关
     epoll_event events[MAX_EVENT_NUMBER];
 
     int m_listenfd;
+    bool m_reuse_port;    // 是否为每个从反应堆开启SO_REUSEPORT监听
+    int m_backlog;        // listen全连接队列长度
     int m_OPT_LINGER;     // 是否优雅关闭连接
     int m_TRIGMode;       // 组合触发模式
     int m_LISTENTrigmode; // 监听fd触发模式
     int m_CONNTrigmode;   // 连接fd触发模式
 
     // 定时器相关
-    client_data *users_timer;
+    client_data *users_timer; // 按fd索引，conn指向连接对象（连接建立时才从slab中借用）
     Utils utils;
+    int m_timer_model; // 定时器容器：0-最小堆，1-分层时间轮
 
     // SSL/TLS协议
     bool use_ssl_;
@@ -93,7 +145,14 @@ public:
     std::shared_ptr<OpenSSLContext> opensslContext_;
     std::map<int, std::shared_ptr<SSLWrapper>> fd_sslwrappers;
 
+    locker m_ssl_lock; // fd_sslwrappers会被多个反应堆线程访问
+
     // 是否进行数据压缩
     bool is_compress_;
+
+    // 从反应堆相关（m_reactor_num为0时退化为单个事件循环）
+    int m_reactor_num;
+    sub_reactor *m_reactors;
+    int m_next_reactor; // 轮询分发的下一个从反应堆
 };
 #endif